@@ -5,18 +5,68 @@
 #include <lua.hpp>
 
 #include <bit>
+#include <span>
 #include <array>
+#include <chrono>
 #include <string>
+#include <limits>
 #include <memory>
 #include <vector>
+#include <ranges>
+#include <utility>
+#include <variant>
 #include <iterator>
+#include <optional>
+#include <unordered_map>
+#include <algorithm>
+#include <functional>
 #include <string_view>
+#include <type_traits>
 
 #include <cstdint>
 #include <cstddef>
 #include <cassert>
+#include <cstring>
 #include <concepts>
 
+/*
+	Static tracepoints, emitted as USDT probes under the "luacpp" provider when sys/sdt.h is available
+	so that perf or bpftrace can attach to them. A detached probe is a single nop, without sys/sdt.h
+	the macros expand to nothing and their arguments are not evaluated.
+
+	Define LUA_CPP_TRACEPOINTS to 0 or 1 to override the detection.
+
+	Probes :
+		load__start(state, name)			load__done(state, status)
+		pcall__start(state, nargs)			pcall__done(state, status)
+		resume__start(thread, nargs)		resume__done(thread, status, nrets)
+		yield(state, nargs)
+		userdata__new(state, size, nuv)
+		gc__step__start(state, kilobytes)	gc__step__done(state, finished)
+		gc__collect__start(state)			gc__collect__done(state)
+		gc__implicit(duration_ns, bytes)	alloc__fail(old_size, new_size)
+*/
+#ifndef LUA_CPP_TRACEPOINTS
+	#if __has_include(<sys/sdt.h>)
+		#define LUA_CPP_TRACEPOINTS 1
+	#else
+		#define LUA_CPP_TRACEPOINTS 0
+	#endif
+#endif
+
+#if LUA_CPP_TRACEPOINTS
+	#include <sys/sdt.h>
+	#define LUA_CPP_TRACE(name) DTRACE_PROBE(luacpp, name)
+	#define LUA_CPP_TRACE1(name, a) DTRACE_PROBE1(luacpp, name, a)
+	#define LUA_CPP_TRACE2(name, a, b) DTRACE_PROBE2(luacpp, name, a, b)
+	#define LUA_CPP_TRACE3(name, a, b, c) DTRACE_PROBE3(luacpp, name, a, b, c)
+#else
+	#define LUA_CPP_TRACE(name)
+	#define LUA_CPP_TRACE1(name, a)
+	#define LUA_CPP_TRACE2(name, a, b)
+	#define LUA_CPP_TRACE3(name, a, b, c)
+#endif
+
 /*
 	Type aliases and enums
 */
@@ -200,13 +250,31 @@ namespace lua
 #pragma region BASIC
 namespace lua
 {
+	namespace impl
+	{
+		/**
+		 * @brief Clears the context pointer kept in the extra space of a new state, lua leaves it uninitialized.
+		*/
+		inline state* init_extraspace(state* l) noexcept
+		{
+			if constexpr (LUA_EXTRASPACE >= sizeof(void*))
+			{
+				if (l)
+				{
+					std::memset(lua_getextraspace(l), 0, sizeof(void*));
+				};
+			};
+			return l;
+		};
+	};
+
 	inline state* newstate(alloc_fn f, void* ud)
 	{
-		return lua_newstate(f, ud);
+		return impl::init_extraspace(lua_newstate(f, ud));
 	};
 	inline state* newstate()
 	{
-		return luaL_newstate();
+		return impl::init_extraspace(luaL_newstate());
 	};
 	
 	inline void close(state* l)
@@ -397,7 +465,17 @@ namespace lua
 	inline const char* type_name(state* l, type t) { return lua_typename(l, (int)t); };
 	inline const char* type_name_of(state* l, int idx) { return type_name(l, type_of(l, idx)); };
 
-	inline state* newthread(state* l) { return lua_newthread(l); };
+	inline state* newthread(state* l)
+	{
+		const auto _thread = lua_newthread(l);
+
+		// Lua copies the main thread's extra space, the context pointer is taken from the parent instead (see lua::context)
+		if constexpr (LUA_EXTRASPACE >= sizeof(void*))
+		{
+			std::memcpy(lua_getextraspace(_thread), lua_getextraspace(l), sizeof(void*));
+		};
+		return _thread;
+	};
 	inline status_code resetthread(state* l) { return status_code(lua_resetthread(l)); };
 	inline void pushthread(state* l) { lua_pushthread(l); };
 
@@ -493,11 +571,14 @@ namespace lua
 	inline resume_result resume(state* _thread, int _nargs = 0, state* _from = nullptr)
 	{
 		int _nrets = 0;
+		LUA_CPP_TRACE2(resume__start, _thread, _nargs);
 		auto _status = ::lua_resume(_thread, _from, _nargs, &_nrets);
+		LUA_CPP_TRACE3(resume__done, _thread, _status, _nrets);
 		return resume_result{ status_code(_status), _nrets };
 	};
 	inline int yield(state* _lua, int _nargs = 0)
 	{
+		LUA_CPP_TRACE2(yield, _lua, _nargs);
 		return lua_yield(_lua, _nargs);
 	};
 
@@ -507,7 +588,9 @@ namespace lua
 	};
 	inline status_code pcall(state* _lua, int _nargs = 0, int _nrets = LUA_MULTRET, int _messageFn = 0)
 	{
+		LUA_CPP_TRACE2(pcall__start, _lua, _nargs);
 		const auto _status = lua_pcall(_lua, _nargs, _nrets, _messageFn);
+		LUA_CPP_TRACE2(pcall__done, _lua, _status);
 		return status_code(_status);
 	};
 	
@@ -754,14 +837,18 @@ namespace lua
 	inline status_code load(state_ptr _lua, reader_fn _reader, void* _userdata, const char* _name, load_mode _mode)
 	{
 		const auto _modeStr = impl::load_mode_str(_mode);
+		LUA_CPP_TRACE2(load__start, _lua, _name);
 		const auto _status = ::lua_load(_lua, _reader, _userdata, _name, _modeStr);
+		LUA_CPP_TRACE2(load__done, _lua, _status);
 		return status_code(_status);
 	};
 
 	inline status_code load(state* _lua, const char* _str, size_t _strLen, const char* _name, load_mode _mode)
 	{
 		const auto _modeStr = impl::load_mode_str(_mode);
+		LUA_CPP_TRACE2(load__start, _lua, _name);
 		const auto _status = luaL_loadbufferx(_lua, _str, _strLen, _name, _modeStr);
+		LUA_CPP_TRACE2(load__done, _lua, _status);
 		return status_code(_status);
 	};
 	inline status_code load(state* _lua, const char* _str, size_t _strLen, load_mode _mode)
@@ -858,8 +945,12 @@ namespace lua
 
 
 
-	inline void* newuserdata(state* _lua, size_t _sizeBytes, int _nUserValues) { return lua_newuserdatauv(_lua, _sizeBytes, _nUserValues); };
-	inline void* newuserdata(state* _lua, size_t _sizeBytes) { return lua_newuserdata(_lua, _sizeBytes); };
+	inline void* newuserdata(state* _lua, size_t _sizeBytes, int _nUserValues)
+	{
+		LUA_CPP_TRACE3(userdata__new, _lua, _sizeBytes, _nUserValues);
+		return lua_newuserdatauv(_lua, _sizeBytes, _nUserValues);
+	};
+	inline void* newuserdata(state* _lua, size_t _sizeBytes) { return newuserdata(_lua, _sizeBytes, 1); };
 
 
 	template <typename T>
@@ -928,6 +1019,344 @@ namespace lua
 		return lua_getmetatable(_lua, _objIndex) == 1;
 	};
 
+
+
+	namespace impl
+	{
+		template <typename T>
+		struct type_key_storage
+		{
+			static inline char value = 0;
+		};
+
+		/**
+		 * @brief Gets a unique per-type key, usable as a light userdata registry key.
+		 * @tparam T Type to get the key of.
+		*/
+		template <typename T>
+		inline void* type_key() noexcept
+		{
+			return &type_key_storage<T>::value;
+		};
+	};
+
+	/**
+	 * @brief Pushes the metatable registered for a C++ type, creating it if it does not exist yet.
+	 *
+	 * Metatables are stored in the registry keyed by the address of a per-type variable, so lookups
+	 * never hash a type name string.
+	 *
+	 * @tparam T Type the metatable is registered for.
+	 * @param _lua Lua state.
+	 * @param _initFn Invoked as _initFn(_lua, _metatableIndex) when the metatable is created.
+	 * @return True if the metatable was created by this call, false if it already existed.
+	*/
+	template <typename T, typename InitFnT>
+	inline bool get_or_create_metatable(state_ptr _lua, InitFnT&& _initFn)
+	{
+		const auto _key = impl::type_key<T>();
+		if (rawget(_lua, LUA_REGISTRYINDEX, _key) == type::table)
+		{
+			return false;
+		};
+		pop(_lua);
+
+		newtable(_lua, 0, 8);
+		std::invoke(std::forward<InitFnT>(_initFn), _lua, top(_lua));
+		copy(_lua, -1);
+		rawset(_lua, LUA_REGISTRYINDEX, _key);
+		return true;
+	};
+
+	/**
+	 * @brief Gets a userdata if its metatable is the one registered for a C++ type.
+	 * @tparam T Type the metatable is registered for.
+	 * @param _lua Lua state.
+	 * @param _index Index of the value to test.
+	 * @return Pointer to the userdata's memory, or nullptr if the value is not a T userdata.
+	*/
+	template <typename T>
+	inline T* testudata(state_ptr _lua, int _index)
+	{
+		if (lua_type(_lua, _index) != LUA_TUSERDATA || !getmetatable(_lua, _index))
+		{
+			return nullptr;
+		};
+
+		rawget(_lua, LUA_REGISTRYINDEX, impl::type_key<T>());
+		const bool _matches = lua_rawequal(_lua, -1, -2) != 0;
+		pop(_lua, 2);
+		return (_matches) ? static_cast<T*>(lua_touserdata(_lua, _index)) : nullptr;
+	};
+
+	/**
+	 * @brief Destroys the T in a userdata, for use in the __gc metamethod registered for T.
+	 *
+	 * The metatable is removed afterwards, so calling __gc again or using the value fails the
+	 * type checks instead of reaching the destroyed object.
+	 *
+	 * @tparam T Type the metatable is registered for.
+	 * @param _lua Lua state.
+	 * @param _index Index of the userdata.
+	 * @param _name Type name used in the error raised when the value is not a T userdata.
+	*/
+	template <typename T>
+	inline void destroy_udata(state_ptr _lua, int _index, const char* _name)
+	{
+		const auto _value = testudata<T>(_lua, _index);
+		if (!_value)
+		{
+			luaL_typeerror(_lua, _index, _name);
+			return;
+		};
+		std::destroy_at(_value);
+
+		lua_pushnil(_lua);
+		lua_setmetatable(_lua, _index);
+	};
+
+};
+#pragma endregion
+
+
+
+/*
+	Per state C++ context
+*/
+
+#pragma region STATE_CONTEXT
+namespace lua
+{
+	// Maximum number of distinct context types used with lua::context, using more aborts the program
+	constexpr inline size_t max_context_types = 16;
+
+	namespace impl
+	{
+		/**
+		 * @brief Context pointers of a lua state, indexed by context_index<T>.
+		 *
+		 * Owned by the state as a registry userdata, its address is kept in the first pointer of
+		 * the extra space (LUA_EXTRASPACE) of each thread when it is large enough.
+		*/
+		struct context_block
+		{
+			std::array<void*, max_context_types> slots{};
+		};
+
+		size_t next_context_index() noexcept;
+
+		template <typename T>
+		inline size_t context_index() noexcept
+		{
+			static const size_t _index = next_context_index();
+			return _index;
+		};
+
+		/**
+		 * @brief Looks the context block up in the registry, caching it in the thread's extra space.
+		 * @return The block, or nullptr if no context was set on the state.
+		*/
+		context_block* find_context_block(state_ptr _lua) noexcept;
+
+		/**
+		 * @brief Gets the context block, creating it on first use.
+		*/
+		context_block& get_or_create_context_block(state_ptr _lua);
+
+		inline context_block* get_context_block(state_ptr _lua) noexcept
+		{
+			if constexpr (LUA_EXTRASPACE >= sizeof(void*))
+			{
+				context_block* _block = nullptr;
+				std::memcpy(&_block, lua_getextraspace(_lua), sizeof(void*));
+				if (_block)
+				{
+					return _block;
+				};
+			};
+			return find_context_block(_lua);
+		};
+	};
+
+	/**
+	 * @brief Gets the C++ context of type T set on a lua state, shared by all of its threads.
+	 *
+	 * Reads a pointer from the thread's extra space, falling back to a registry lookup when
+	 * LUA_EXTRASPACE cannot hold a pointer. The state must have been created by lua::newstate,
+	 * or have had a context set, as lua leaves the extra space of new states uninitialized.
+	 *
+	 * @return The context, or nullptr if none was set.
+	*/
+	template <typename T>
+	inline T* context(state_ptr _lua) noexcept
+	{
+		const auto _block = impl::get_context_block(_lua);
+		return (_block) ? static_cast<T*>(_block->slots[impl::context_index<T>()]) : nullptr;
+	};
+
+	/**
+	 * @brief Sets the C++ context of type T of a lua state, it is not owned by the state and must outlive it.
+	*/
+	template <typename T>
+	inline void set_context(state_ptr _lua, T* _context)
+	{
+		impl::get_or_create_context_block(_lua).slots[impl::context_index<T>()] = _context;
+	};
+};
+#pragma endregion
+
+
+
+/*
+	Compile time module definitions
+*/
+
+#pragma region MODULE_DEFINITIONS
+namespace lua
+{
+	/**
+	 * @brief Function entry of a module_definition.
+	*/
+	struct module_function
+	{
+		const char* name;
+		lua_CFunction function;
+
+		// Accepted argument counts for documentation and tooling, not checked on calls. -1 max_args means variadic.
+		int min_args = 0;
+		int max_args = -1;
+	};
+
+	/**
+	 * @brief Submodule entry of a module_definition.
+	*/
+	struct module_submodule
+	{
+		const char* name;
+
+		// Pushes the submodule, called with its name like the openf of luaL_requiref (ie. lua::open_bytes)
+		lua_CFunction open;
+
+		// Lazy submodules are opened the first time they are indexed
+		bool lazy = true;
+	};
+
+	/**
+	 * @brief Module description built at compile time, registered in one batch by push_module.
+	 *
+	 * Duplicate names are a compile error when the definition is constexpr :
+	 * @code
+	 *	constexpr auto mathx_module = lua::module_definition{ "mathx",
+	 *		{ { "clamp", &mathx_clamp, 3, 3 }, { "lerp", &mathx_lerp, 3, 3 } },
+	 *		{ { "vec", &open_vec } } };
+	 *	luaL_requiref(_lua, mathx_module.name(), &lua::open_module<mathx_module>, 1);
+	 * @endcode
+	*/
+	template <size_t N, size_t M = 0>
+	class module_definition
+	{
+	public:
+		constexpr const char* name() const noexcept { return this->name_; };
+		constexpr std::span<const module_function> functions() const noexcept { return this->functions_; };
+		constexpr std::span<const module_submodule> submodules() const noexcept { return this->submodules_; };
+
+		/**
+		 * @brief Gets the function entries as a luaL_Reg array terminated by a null entry, for luaL_setfuncs.
+		*/
+		constexpr const luaL_Reg* registry() const noexcept { return this->registry_.data(); };
+
+		constexpr const module_function* find(std::string_view _name) const noexcept
+		{
+			for (const auto& _function : this->functions_)
+			{
+				if (_name == _function.name)
+				{
+					return &_function;
+				};
+			};
+			return nullptr;
+		};
+
+		constexpr module_definition(const char* _name, const module_function(&_functions)[N]) :
+			name_(_name)
+		{
+			this->init(_functions);
+		};
+		// A template so that definitions without submodules never form a zero length array parameter
+		template <size_t K>
+		requires (K == M && K != 0)
+		constexpr module_definition(const char* _name, const module_function(&_functions)[N], const module_submodule(&_submodules)[K]) :
+			name_(_name)
+		{
+			this->init(_functions);
+			for (size_t n = 0; n != M; ++n)
+			{
+				for (size_t i = 0; i != N; ++i)
+				{
+					if (std::string_view(_submodules[n].name) == _functions[i].name)
+					{
+						throw "duplicate name in module definition";
+					};
+				};
+				this->submodules_[n] = _submodules[n];
+			};
+		};
+
+	private:
+		constexpr void init(const module_function(&_functions)[N])
+		{
+			for (size_t n = 0; n != N; ++n)
+			{
+				for (size_t i = 0; i != n; ++i)
+				{
+					if (std::string_view(_functions[i].name) == _functions[n].name)
+					{
+						throw "duplicate name in module definition";
+					};
+				};
+				this->functions_[n] = _functions[n];
+				this->registry_[n] = luaL_Reg{ _functions[n].name, _functions[n].function };
+			};
+			this->registry_[N] = luaL_Reg{ nullptr, nullptr };
+		};
+
+		const char* name_;
+		std::array<module_function, N> functions_{};
+		std::array<luaL_Reg, N + 1> registry_{};
+		std::array<module_submodule, M> submodules_{};
+	};
+
+	template <size_t N, size_t M>
+	module_definition(const char*, const module_function(&)[N], const module_submodule(&)[M]) -> module_definition<N, M>;
+
+	namespace impl
+	{
+		void push_module(state_ptr _lua, const luaL_Reg* _registry, size_t _count, std::span<const module_submodule> _submodules, int _nup);
+	};
+
+	/**
+	 * @brief Pushes a new table holding the functions and submodules of a module definition.
+	 *
+	 * The table is created presized and filled with a single luaL_setfuncs call, lazy submodules are
+	 * resolved through an __index metamethod and are not visible to pairs until opened.
+	 *
+	 * @param _nup Number of upvalues on top of the stack shared by all functions, they are popped.
+	*/
+	template <size_t N, size_t M>
+	inline void push_module(state_ptr _lua, const module_definition<N, M>& _module, int _nup = 0)
+	{
+		impl::push_module(_lua, _module.registry(), N, _module.submodules(), _nup);
+	};
+
+	/**
+	 * @brief Module opening function for a constexpr module definition, usable with luaL_requiref.
+	*/
+	template <const auto& Module>
+	inline int open_module(state_ptr _lua)
+	{
+		push_module(_lua, Module);
+		return 1;
+	};
 };
 #pragma endregion
 
@@ -1187,6 +1616,4428 @@ namespace lua
 
 
 
+/*
+	Enum stack traits, enumerators are exchanged by name when a name table is declared
+*/
+
+#pragma region ENUM_TRAITS
+namespace lua
+{
+	/**
+	 * @brief Name of an enumerator, see enum_names.
+	*/
+	template <typename E>
+	struct enum_entry
+	{
+		std::string_view name;
+		E value;
+	};
+
+	template <size_t N, typename E>
+	enum_entry(const char(&)[N], E) -> enum_entry<E>;
+
+	/**
+	 * @brief Customization point declaring the enumerator names of an enum, specialize on this.
+	 *
+	 * Named enums are pushed as strings and pulled from their names or from integers, other enums are
+	 * exchanged as their underlying integer.
+	 * @code
+	 *	template <>
+	 *	struct lua::enum_names<open_mode>
+	 *	{
+	 *		static constexpr auto entries = std::array
+	 *		{
+	 *			lua::enum_entry{ "read_only", open_mode::read_only },
+	 *			lua::enum_entry{ "read_write", open_mode::read_write },
+	 *		};
+	 *	};
+	 * @endcode
+	*/
+	template <typename E>
+	struct enum_names;
+
+	template <typename E>
+	concept cx_named_enum = std::is_enum_v<E> && requires
+	{
+		{ enum_names<E>::entries.size() } -> std::convertible_to<size_t>;
+		{ enum_names<E>::entries[0] } -> std::convertible_to<enum_entry<E>>;
+	};
+
+	namespace impl
+	{
+		// FNV-1a over the name bytes, the same function is used to build and to probe the table
+		constexpr uint64_t enum_name_hash(std::string_view _name) noexcept
+		{
+			uint64_t _hash = 0xCBF29CE484222325;
+			for (const auto c : _name)
+			{
+				_hash ^= static_cast<uint8_t>(c);
+				_hash *= 0x100000001B3;
+			};
+			return _hash;
+		};
+
+		// Slot of a name hash for a bucket displacement
+		constexpr uint64_t enum_slot_hash(uint64_t _hash, uint32_t _displacement) noexcept
+		{
+			_hash ^= static_cast<uint64_t>(_displacement) * 0x9E3779B97F4A7C15;
+			_hash ^= _hash >> 33;
+			_hash *= 0xFF51AFD7ED558CCD;
+			_hash ^= _hash >> 33;
+			return _hash;
+		};
+
+		/**
+		 * @brief Minimal perfect hash of the enumerator names of E, built at compile time.
+		 *
+		 * Names are split in buckets by their hash, then each bucket, largest first, is given the first
+		 * displacement placing all its names in free slots. A lookup hashes the string once, reads the
+		 * bucket displacement and compares the single candidate name.
+		*/
+		template <typename E>
+		struct enum_table
+		{
+			static constexpr auto& entries = enum_names<E>::entries;
+			static constexpr size_t count = entries.size();
+			static constexpr size_t bucket_count = std::bit_ceil(std::max<size_t>(count / 2, 1));
+			static constexpr size_t slot_count = std::bit_ceil(std::max<size_t>(count, 1)) * 2;
+
+			struct hash_table
+			{
+				std::array<uint32_t, bucket_count> displacements{};
+
+				// Entry index + 1 of each slot, 0 if empty
+				std::array<uint16_t, slot_count> slots{};
+			};
+
+			static_assert(count != 0, "enum_names must declare at least one enumerator");
+			static_assert(count < 0xFFFF, "too many enumerator names");
+
+			static consteval hash_table make_hash_table()
+			{
+				for (size_t n = 0; n != count; ++n)
+				{
+					for (size_t m = n + 1; m != count; ++m)
+					{
+						if (entries[n].name == entries[m].name)
+						{
+							throw "duplicate enumerator name";
+						};
+					};
+				};
+
+				std::array<std::array<uint16_t, count>, bucket_count> _members{};
+				std::array<size_t, bucket_count> _sizes{};
+				for (size_t n = 0; n != count; ++n)
+				{
+					const auto _bucket = enum_name_hash(entries[n].name) & (bucket_count - 1);
+					_members[_bucket][_sizes[_bucket]++] = static_cast<uint16_t>(n);
+				};
+
+				std::array<size_t, bucket_count> _order{};
+				for (size_t n = 0; n != bucket_count; ++n)
+				{
+					_order[n] = n;
+				};
+				std::ranges::sort(_order, [&_sizes](size_t _lhs, size_t _rhs)
+				{
+					return (_sizes[_lhs] != _sizes[_rhs]) ? _sizes[_lhs] > _sizes[_rhs] : _lhs < _rhs;
+				});
+
+				auto _table = hash_table{};
+				for (const auto _bucket : _order)
+				{
+					const auto _size = _sizes[_bucket];
+					if (_size == 0)
+					{
+						break;
+					};
+
+					for (uint32_t _displacement = 1; ; ++_displacement)
+					{
+						if (_displacement == 0x100000)
+						{
+							throw "no perfect hash found for the enumerator names";
+						};
+
+						std::array<size_t, count> _placed{};
+						bool _fits = true;
+						for (size_t n = 0; n != _size && _fits; ++n)
+						{
+							const auto _entry = _members[_bucket][n];
+							const auto _slot = enum_slot_hash(enum_name_hash(entries[_entry].name), _displacement) & (slot_count - 1);
+							_fits = _table.slots[_slot] == 0 &&
+								std::find(_placed.begin(), _placed.begin() + n, _slot) == _placed.begin() + n;
+							_placed[n] = _slot;
+						};
+						if (!_fits)
+						{
+							continue;
+						};
+
+						for (size_t n = 0; n != _size; ++n)
+						{
+							_table.slots[_placed[n]] = static_cast<uint16_t>(_members[_bucket][n] + 1);
+						};
+						_table.displacements[_bucket] = _displacement;
+						break;
+					};
+				};
+				return _table;
+			};
+
+			static constexpr hash_table table = make_hash_table();
+
+			/**
+			 * @brief Finds the entry index of an enumerator name.
+			 * @return The index, or count if the name is not one of the enumerators.
+			*/
+			static constexpr size_t find(std::string_view _name) noexcept
+			{
+				const auto _hash = enum_name_hash(_name);
+				const auto _displacement = table.displacements[_hash & (bucket_count - 1)];
+				const auto _slot = table.slots[enum_slot_hash(_hash, _displacement) & (slot_count - 1)];
+				return (_slot != 0 && entries[_slot - 1].name == _name) ? _slot - 1 : count;
+			};
+
+			// Entry indices sorted by value, for finding the name of a value
+			static constexpr auto by_value = []()
+			{
+				std::array<uint16_t, count> _indices{};
+				for (size_t n = 0; n != count; ++n)
+				{
+					_indices[n] = static_cast<uint16_t>(n);
+				};
+				std::ranges::sort(_indices, [](uint16_t _lhs, uint16_t _rhs)
+				{
+					const auto _lhsValue = static_cast<std::underlying_type_t<E>>(entries[_lhs].value);
+					const auto _rhsValue = static_cast<std::underlying_type_t<E>>(entries[_rhs].value);
+					return (_lhsValue != _rhsValue) ? _lhsValue < _rhsValue : _lhs < _rhs;
+				});
+				return _indices;
+			}();
+
+			/**
+			 * @brief Finds the entry index of an enumerator value, the first declared wins for aliases.
+			 * @return The index, or count if the value has no name.
+			*/
+			static constexpr size_t find(E _value) noexcept
+			{
+				const auto _found = std::ranges::lower_bound(by_value, static_cast<std::underlying_type_t<E>>(_value), std::ranges::less{},
+					[](uint16_t _index) { return static_cast<std::underlying_type_t<E>>(entries[_index].value); });
+				return (_found != by_value.end() && entries[*_found].value == _value) ? *_found : count;
+			};
+
+			static constexpr auto names = []()
+			{
+				std::array<std::string_view, count> _names{};
+				for (size_t n = 0; n != count; ++n)
+				{
+					_names[n] = entries[n].name;
+				};
+				return _names;
+			}();
+		};
+
+		/**
+		 * @brief Pushes the table caching the name strings of an enum, creating it if needed.
+		*/
+		void push_enum_name_cache(state_ptr _lua, void* _key, const std::string_view* _names, size_t _count);
+	};
+
+	/**
+	 * @brief Gets the value of an enumerator name.
+	 * @return The value, or nullopt if the name is not one of the enumerators.
+	*/
+	template <cx_named_enum E>
+	constexpr std::optional<E> enum_from_name(std::string_view _name) noexcept
+	{
+		using table = impl::enum_table<E>;
+		const auto _index = table::find(_name);
+		return (_index != table::count) ? std::optional<E>(table::entries[_index].value) : std::nullopt;
+	};
+
+	/**
+	 * @brief Gets the name of an enumerator.
+	 * @return The name, or an empty string if the value has none.
+	*/
+	template <cx_named_enum E>
+	constexpr std::string_view enum_to_name(E _value) noexcept
+	{
+		using table = impl::enum_table<E>;
+		const auto _index = table::find(_value);
+		return (_index != table::count) ? table::entries[_index].name : std::string_view();
+	};
+
+	/**
+	 * @brief Stack traits for named enums, pushed as cached name strings.
+	 *
+	 * Values without a name are pushed as integers. Strings are looked up with the compile time perfect
+	 * hash of the names, integers are converted to the underlying type, anything else leaves the
+	 * value unchanged.
+	*/
+	template <cx_named_enum E>
+	struct stack_traits<E>
+	{
+		using type = E;
+		static void push(state_ptr _lua, const type& _value)
+		{
+			using table = impl::enum_table<E>;
+			const auto _index = table::find(_value);
+			if (_index == table::count)
+			{
+				lua_pushinteger(_lua, static_cast<lua_Integer>(_value));
+				return;
+			};
+
+			impl::push_enum_name_cache(_lua, impl::type_key<enum_names<E>>(), table::names.data(), table::count);
+			lua_rawgeti(_lua, -1, static_cast<lua_Integer>(_index) + 1);
+			lua_remove(_lua, -2);
+		};
+		static void to(state_ptr _lua, int _index, type& _value)
+		{
+			if (lua_type(_lua, _index) == LUA_TSTRING)
+			{
+				size_t _len = 0;
+				const auto _str = lua_tolstring(_lua, _index, &_len);
+				if (const auto _found = enum_from_name<E>(std::string_view(_str, _len)); _found)
+				{
+					_value = *_found;
+				};
+			}
+			else if (lua_isinteger(_lua, _index))
+			{
+				_value = static_cast<type>(lua_tointeger(_lua, _index));
+			};
+		};
+	};
+
+	/**
+	 * @brief Stack traits for enums without names, exchanged as their underlying integer.
+	*/
+	template <typename E>
+	requires (std::is_enum_v<E> && !cx_named_enum<E>)
+	struct stack_traits<E>
+	{
+		using type = E;
+		static void push(state_ptr _lua, const type& _value)
+		{
+			lua_pushinteger(_lua, static_cast<lua_Integer>(_value));
+		};
+		static void to(state_ptr _lua, int _index, type& _value)
+		{
+			_value = static_cast<type>(lua_tointeger(_lua, _index));
+		};
+	};
+
+	/**
+	 * @brief Gets a named enum argument, raising an argument error for unknown names like luaL_checkoption.
+	*/
+	template <cx_named_enum E>
+	inline E check_enum(state_ptr _lua, int _arg)
+	{
+		if (lua_isinteger(_lua, _arg))
+		{
+			return static_cast<E>(lua_tointeger(_lua, _arg));
+		};
+
+		size_t _len = 0;
+		const auto _str = luaL_checklstring(_lua, _arg, &_len);
+		const auto _found = enum_from_name<E>(std::string_view(_str, _len));
+		if (!_found)
+		{
+			luaL_argerror(_lua, _arg, lua_pushfstring(_lua, "invalid option '%s'", _str));
+		};
+		return *_found;
+	};
+};
+#pragma endregion
+
+
+
+/*
+	Stack traits for optional, variant and tuple types
+*/
+
+#pragma region VOCABULARY_TRAITS
+namespace lua
+{
+	namespace impl
+	{
+		template <typename T>
+		struct is_std_optional : std::false_type {};
+		template <typename T>
+		struct is_std_optional<std::optional<T>> : std::true_type {};
+
+		template <typename T>
+		struct is_std_variant : std::false_type {};
+		template <typename... Ts>
+		struct is_std_variant<std::variant<Ts...>> : std::true_type {};
+	};
+
+	/**
+	 * @brief Stack traits for optional values, nullopt is exchanged as nil.
+	 *
+	 * Missing arguments (none) are pulled as nullopt as well.
+	*/
+	template <typename T>
+	struct stack_traits<std::optional<T>>
+	{
+		using type = std::optional<T>;
+		static void push(state_ptr _lua, const type& _value)
+			requires cx_pushable<const T&>
+		{
+			if (_value)
+			{
+				lua::push(_lua, *_value);
+			}
+			else
+			{
+				lua_pushnil(_lua);
+			};
+		};
+		static void to(state_ptr _lua, int _index, type& _value)
+			requires cx_pullable<T>
+		{
+			if (lua_isnoneornil(_lua, _index))
+			{
+				_value.reset();
+				return;
+			};
+			auto _inner = T{};
+			lua::to(_lua, _index, _inner);
+			_value.emplace(std::move(_inner));
+		};
+	};
+
+	template <>
+	struct stack_traits<std::monostate>
+	{
+		using type = std::monostate;
+		static void push(state_ptr _lua, const type&)
+		{
+			lua_pushnil(_lua);
+		};
+		static void to(state_ptr, int, type&)
+		{
+		};
+	};
+
+	namespace impl
+	{
+		// Slot of integer values in variant dispatch tables, the other slots are lua types
+		constexpr inline size_t variant_integer_slot = LUA_NUMTYPES;
+		constexpr inline size_t variant_slot_count = LUA_NUMTYPES + 1;
+
+		struct variant_slots
+		{
+			// Bitmasks of the slots an alternative takes as is, and of those it takes with a conversion
+			uint32_t exact = 0;
+			uint32_t converted = 0;
+		};
+
+		template <typename T>
+		constexpr variant_slots variant_slots_of() noexcept
+		{
+			constexpr auto slot = [](size_t _slot) { return uint32_t(1) << _slot; };
+			if constexpr (std::is_same_v<T, std::monostate> || std::is_same_v<T, nil_t>)
+			{
+				return variant_slots{ slot(LUA_TNIL) };
+			}
+			else if constexpr (std::is_same_v<T, bool>)
+			{
+				return variant_slots{ slot(LUA_TBOOLEAN) };
+			}
+			else if constexpr (std::is_integral_v<T> || (std::is_enum_v<T> && !cx_named_enum<T>))
+			{
+				return variant_slots{ slot(variant_integer_slot) };
+			}
+			else if constexpr (std::is_floating_point_v<T>)
+			{
+				return variant_slots{ slot(LUA_TNUMBER), slot(variant_integer_slot) };
+			}
+			else if constexpr (cx_named_enum<T>)
+			{
+				return variant_slots{ slot(LUA_TSTRING), slot(variant_integer_slot) };
+			}
+			else if constexpr (std::is_same_v<T, lua_CFunction>)
+			{
+				return variant_slots{ slot(LUA_TFUNCTION) };
+			}
+			else
+			{
+				static_assert(std::is_constructible_v<std::string_view, T>,
+					"variant alternative has no lua type to be selected from");
+				return variant_slots{ slot(LUA_TSTRING) };
+			};
+		};
+
+		/**
+		 * @brief Alternative index pulled for each slot, -1 if none, the first alternative taking a slot as is wins.
+		*/
+		template <typename... Ts>
+		constexpr auto make_variant_dispatch() noexcept
+		{
+			constexpr auto _slots = std::array<variant_slots, sizeof...(Ts)>{ variant_slots_of<Ts>()... };
+			auto _dispatch = std::array<int8_t, variant_slot_count>{};
+			_dispatch.fill(-1);
+			for (const auto _converted : { false, true })
+			{
+				for (size_t n = 0; n != _slots.size(); ++n)
+				{
+					const auto _mask = (_converted) ? _slots[n].converted : _slots[n].exact;
+					for (size_t s = 0; s != variant_slot_count; ++s)
+					{
+						if (_dispatch[s] == -1 && (_mask & (uint32_t(1) << s)))
+						{
+							_dispatch[s] = static_cast<int8_t>(n);
+						};
+					};
+				};
+			};
+			return _dispatch;
+		};
+	};
+
+	/**
+	 * @brief Stack traits for variants.
+	 *
+	 * The alternative pulled is selected by the value's lua type with a compile time table, integers
+	 * preferring integral alternatives and strings named enums after string types, so no conversion
+	 * is attempted. Values no alternative takes leave the variant unchanged.
+	*/
+	template <typename... Ts>
+	struct stack_traits<std::variant<Ts...>>
+	{
+		using type = std::variant<Ts...>;
+		static void push(state_ptr _lua, const type& _value)
+			requires (cx_pushable<const Ts&> && ...)
+		{
+			std::visit([_lua](const auto& _alternative) { lua::push(_lua, _alternative); }, _value);
+		};
+		static void to(state_ptr _lua, int _index, type& _value)
+			requires (cx_pullable<Ts> && ...)
+		{
+			static constexpr auto _dispatch = impl::make_variant_dispatch<Ts...>();
+
+			const auto _type = lua_type(_lua, _index);
+			auto _slot = static_cast<size_t>((_type == LUA_TNONE) ? LUA_TNIL : _type);
+			if (_type == LUA_TNUMBER && lua_isinteger(_lua, _index))
+			{
+				_slot = impl::variant_integer_slot;
+			};
+
+			const auto _alternative = _dispatch[_slot];
+			[&]<size_t... Is>(std::index_sequence<Is...>)
+			{
+				((_alternative == static_cast<int>(Is) && (pull_alternative<Is>(_lua, _index, _value), true)) || ...);
+			}(std::index_sequence_for<Ts...>{});
+		};
+
+	private:
+		template <size_t I>
+		static void pull_alternative(state_ptr _lua, int _index, type& _value)
+		{
+			auto _alternative = std::variant_alternative_t<I, type>{};
+			lua::to(_lua, _index, _alternative);
+			_value.template emplace<I>(std::move(_alternative));
+		};
+	};
+
+	/**
+	 * @brief Stack traits for tuples, exchanged as consecutive values.
+	 *
+	 * Pushing leaves one value per element, so functions return them as multiple results without
+	 * building a table. Pulling reads the elements from _index onwards.
+	*/
+	template <typename... Ts>
+	struct stack_traits<std::tuple<Ts...>>
+	{
+		using type = std::tuple<Ts...>;
+		static void push(state_ptr _lua, const type& _value)
+			requires (cx_pushable<const Ts&> && ...)
+		{
+			std::apply([_lua](const auto&... _elements) { (lua::push(_lua, _elements), ...); }, _value);
+		};
+		static void to(state_ptr _lua, int _index, type& _value)
+			requires (cx_pullable<Ts> && ...)
+		{
+			_index = abs(_lua, _index);
+			[&]<size_t... Is>(std::index_sequence<Is...>)
+			{
+				(lua::to(_lua, _index + static_cast<int>(Is), std::get<Is>(_value)), ...);
+			}(std::index_sequence_for<Ts...>{});
+		};
+	};
+
+	/**
+	 * @brief Stack traits for pairs, exchanged as two consecutive values like a tuple.
+	*/
+	template <typename T, typename U>
+	struct stack_traits<std::pair<T, U>>
+	{
+		using type = std::pair<T, U>;
+		static void push(state_ptr _lua, const type& _value)
+			requires cx_pushable<const T&> && cx_pushable<const U&>
+		{
+			lua::push(_lua, _value.first);
+			lua::push(_lua, _value.second);
+		};
+		static void to(state_ptr _lua, int _index, type& _value)
+			requires cx_pullable<T> && cx_pullable<U>
+		{
+			_index = abs(_lua, _index);
+			lua::to(_lua, _index, _value.first);
+			lua::to(_lua, _index + 1, _value.second);
+		};
+	};
+};
+#pragma endregion
+
+
+
+/*
+	Checked conversions, reporting errors as values instead of raising lua errors
+*/
+
+#pragma region CHECKED_CONVERSIONS
+namespace lua
+{
+	/**
+	 * @brief Error value of an expected, see expected.
+	*/
+	template <typename E>
+	class unexpected
+	{
+	public:
+		const E& error() const& noexcept { return this->error_; };
+		E&& error() && noexcept { return std::move(this->error_); };
+
+		explicit unexpected(E _error) :
+			error_(std::move(_error))
+		{};
+
+	private:
+		E error_;
+	};
+
+	/**
+	 * @brief Holds either a value or the error that prevented getting it.
+	 *
+	 * A subset of C++23 std::expected, accessing the value of an expected holding an error is
+	 * undefined behavior instead of throwing.
+	*/
+	template <typename T, typename E>
+	class expected
+	{
+	public:
+		using value_type = T;
+		using error_type = E;
+
+		bool has_value() const noexcept { return this->value_.index() == 0; };
+		explicit operator bool() const noexcept { return this->has_value(); };
+
+		T& value() & noexcept
+		{
+			assert(this->has_value());
+			return *std::get_if<0>(&this->value_);
+		};
+		const T& value() const& noexcept
+		{
+			assert(this->has_value());
+			return *std::get_if<0>(&this->value_);
+		};
+		T&& value() && noexcept
+		{
+			assert(this->has_value());
+			return std::move(*std::get_if<0>(&this->value_));
+		};
+
+		T& operator*() & noexcept { return this->value(); };
+		const T& operator*() const& noexcept { return this->value(); };
+		T&& operator*() && noexcept { return std::move(*this).value(); };
+		T* operator->() noexcept { return &this->value(); };
+		const T* operator->() const noexcept { return &this->value(); };
+
+		const E& error() const noexcept
+		{
+			assert(!this->has_value());
+			return *std::get_if<1>(&this->value_);
+		};
+
+		template <typename U>
+		T value_or(U&& _default) const&
+		{
+			return (this->has_value()) ? this->value() : static_cast<T>(std::forward<U>(_default));
+		};
+
+		expected(const T& _value) :
+			value_(std::in_place_index<0>, _value)
+		{};
+		expected(T&& _value) :
+			value_(std::in_place_index<0>, std::move(_value))
+		{};
+		expected(unexpected<E> _error) :
+			value_(std::in_place_index<1>, std::move(_error).error())
+		{};
+
+	private:
+		std::variant<T, E> value_;
+	};
+
+	/**
+	 * @brief Reasons a stack value could not be converted.
+	*/
+	enum class conversion_errc
+	{
+		/**
+		 * @brief The value's type cannot be converted.
+		*/
+		wrong_type,
+
+		/**
+		 * @brief A float without an exact integer value.
+		*/
+		not_an_integer,
+
+		/**
+		 * @brief An integer outside of the range of the target type.
+		*/
+		out_of_range,
+
+		/**
+		 * @brief A string that is not one of the names of an enum.
+		*/
+		invalid_name,
+
+		/**
+		 * @brief A container view whose lifetime has expired.
+		*/
+		expired,
+
+		/**
+		 * @brief Bytes which are not aligned for, or a whole number of, the viewed elements.
+		*/
+		misaligned,
+	};
+
+	/**
+	 * @brief Describes a failed conversion of a stack value.
+	*/
+	struct conversion_error
+	{
+		// Absolute index of the value
+		int index = 0;
+
+		conversion_errc code = conversion_errc::wrong_type;
+
+		// Name of the expected type
+		const char* expected = nullptr;
+
+		// Lua type of the value
+		int type = LUA_TNONE;
+	};
+
+	/**
+	 * @brief Pushes the message of a conversion error, such as "integer expected, got string".
+	 * @return The message.
+	*/
+	const char* push_conversion_error(state_ptr _lua, const conversion_error& _error);
+
+	namespace impl
+	{
+		inline unexpected<conversion_error> conversion_failure(state_ptr _lua, int _index, conversion_errc _code, const char* _expected)
+		{
+			return unexpected<conversion_error>(conversion_error{ _index, _code, _expected, lua_type(_lua, _index) });
+		};
+
+		/**
+		 * @brief Raises a single error describing the failed conversions of a function's arguments.
+		*/
+		[[noreturn]] void raise_argument_errors(state_ptr _lua, const conversion_error* _errors, size_t _count);
+	};
+
+	/**
+	 * @brief Types with a checked conversion, besides std::optional of them.
+	*/
+	template <typename T>
+	concept cx_try_pullable_value =
+		requires(state_ptr _lua, int _index)
+		{
+			{ stack_traits<T>::try_to(_lua, _index) } -> std::same_as<expected<T, conversion_error>>;
+		} ||
+		std::is_arithmetic_v<T> || std::is_enum_v<T> || std::is_same_v<T, lua_CFunction> ||
+		std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view> || std::is_same_v<T, const char*>;
+
+	/**
+	 * @brief Types which can be converted with try_to.
+	*/
+	template <typename T>
+	concept cx_try_pullable = cx_try_pullable_value<T> ||
+		(impl::is_std_optional<T>::value && cx_try_pullable_value<typename T::value_type>);
+
+	namespace impl
+	{
+		template <typename T>
+		concept cx_character = std::is_same_v<T, char> || std::is_same_v<T, wchar_t> ||
+			std::is_same_v<T, char8_t> || std::is_same_v<T, char16_t> || std::is_same_v<T, char32_t>;
+
+		// std::in_range rejects character types, their limits all fit in a lua_Integer
+		template <typename T>
+		constexpr bool in_integer_range(lua_Integer _value) noexcept
+		{
+			if constexpr (cx_character<T>)
+			{
+				return _value >= static_cast<lua_Integer>(std::numeric_limits<T>::min()) &&
+					_value <= static_cast<lua_Integer>(std::numeric_limits<T>::max());
+			}
+			else
+			{
+				return std::in_range<T>(_value);
+			};
+		};
+	};
+
+	/**
+	 * @brief Converts a stack value, returning an error instead of raising one if it is not convertible.
+	 *
+	 * Integers are read with lua_tointegerx and range checked, floats with lua_tonumberx, strings
+	 * accept numbers like luaL_checklstring, named enums accept their names and integers, and
+	 * std::optional accepts nil and none. The value's type is only probed on the error path.
+	 * Other types can take part by defining a static try_to(state_ptr, int) in their stack_traits.
+	 *
+	 * @return The value, or the conversion error.
+	*/
+	template <cx_try_pullable T>
+	inline expected<T, conversion_error> try_to(state_ptr _lua, int _index)
+	{
+		_index = abs(_lua, _index);
+		if constexpr (requires { { stack_traits<T>::try_to(_lua, _index) } -> std::same_as<expected<T, conversion_error>>; })
+		{
+			return stack_traits<T>::try_to(_lua, _index);
+		}
+		else if constexpr (std::is_same_v<T, bool>)
+		{
+			const auto _type = lua_type(_lua, _index);
+			if (_type != LUA_TBOOLEAN && _type != LUA_TNIL && _type != LUA_TNONE)
+			{
+				return impl::conversion_failure(_lua, _index, conversion_errc::wrong_type, "boolean");
+			};
+			return lua_toboolean(_lua, _index) != 0;
+		}
+		else if constexpr (std::is_integral_v<T>)
+		{
+			int _isInteger = 0;
+			const auto _value = lua_tointegerx(_lua, _index, &_isInteger);
+			if (!_isInteger)
+			{
+				const auto _code = (lua_type(_lua, _index) == LUA_TNUMBER) ? conversion_errc::not_an_integer : conversion_errc::wrong_type;
+				return impl::conversion_failure(_lua, _index, _code, "integer");
+			};
+			if constexpr (!std::is_same_v<T, lua_Integer>)
+			{
+				if (!impl::in_integer_range<T>(_value))
+				{
+					return impl::conversion_failure(_lua, _index, conversion_errc::out_of_range, "integer");
+				};
+			};
+			return static_cast<T>(_value);
+		}
+		else if constexpr (std::is_floating_point_v<T>)
+		{
+			int _isNumber = 0;
+			const auto _value = lua_tonumberx(_lua, _index, &_isNumber);
+			if (!_isNumber)
+			{
+				return impl::conversion_failure(_lua, _index, conversion_errc::wrong_type, "number");
+			};
+			return static_cast<T>(_value);
+		}
+		else if constexpr (cx_named_enum<T>)
+		{
+			if (lua_type(_lua, _index) == LUA_TSTRING)
+			{
+				size_t _len = 0;
+				const auto _str = lua_tolstring(_lua, _index, &_len);
+				if (const auto _found = enum_from_name<T>(std::string_view(_str, _len)); _found)
+				{
+					return *_found;
+				};
+				return impl::conversion_failure(_lua, _index, conversion_errc::invalid_name, "string");
+			};
+
+			auto _value = try_to<std::underlying_type_t<T>>(_lua, _index);
+			if (!_value)
+			{
+				return impl::conversion_failure(_lua, _index, _value.error().code, "string");
+			};
+			return static_cast<T>(*_value);
+		}
+		else if constexpr (std::is_enum_v<T>)
+		{
+			auto _value = try_to<std::underlying_type_t<T>>(_lua, _index);
+			if (!_value)
+			{
+				return unexpected<conversion_error>(_value.error());
+			};
+			return static_cast<T>(*_value);
+		}
+		else if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view> || std::is_same_v<T, const char*>)
+		{
+			size_t _len = 0;
+			const auto _str = lua_tolstring(_lua, _index, &_len);
+			if (!_str)
+			{
+				return impl::conversion_failure(_lua, _index, conversion_errc::wrong_type, "string");
+			};
+			if constexpr (std::is_same_v<T, const char*>)
+			{
+				return _str;
+			}
+			else
+			{
+				return T(_str, _len);
+			};
+		}
+		else if constexpr (std::is_same_v<T, lua_CFunction>)
+		{
+			const auto _function = lua_tocfunction(_lua, _index);
+			if (!_function)
+			{
+				return impl::conversion_failure(_lua, _index, conversion_errc::wrong_type, "C function");
+			};
+			return _function;
+		}
+		else
+		{
+			if (lua_isnoneornil(_lua, _index))
+			{
+				return T();
+			};
+			auto _value = try_to<typename T::value_type>(_lua, _index);
+			if (!_value)
+			{
+				return unexpected<conversion_error>(_value.error());
+			};
+			return T(std::move(*_value));
+		};
+	};
+};
+#pragma endregion
+
+
+
+/*
+	std::chrono stack traits and fast clocks
+*/
+
+#pragma region CHRONO_TRAITS
+namespace lua
+{
+	/**
+	 * @brief How durations and time points are exchanged with lua.
+	*/
+	enum class time_encoding
+	{
+		/**
+		 * @brief Integer nanoseconds.
+		*/
+		nanoseconds,
+
+		/**
+		 * @brief Integer milliseconds.
+		*/
+		milliseconds,
+
+		/**
+		 * @brief Integer seconds, like os.time.
+		*/
+		seconds,
+
+		/**
+		 * @brief Float seconds, like os.clock.
+		*/
+		float_seconds,
+	};
+
+	namespace impl
+	{
+		template <typename T>
+		struct is_chrono_duration : std::false_type {};
+		template <typename R, typename P>
+		struct is_chrono_duration<std::chrono::duration<R, P>> : std::true_type {};
+
+		template <typename T>
+		struct is_chrono_time_point : std::false_type {};
+		template <typename C, typename D>
+		struct is_chrono_time_point<std::chrono::time_point<C, D>> : std::true_type {};
+
+		/**
+		 * @brief Encoding used when none is given, the closest to the duration's own representation.
+		*/
+		template <typename D>
+		constexpr time_encoding default_time_encoding() noexcept
+		{
+			using period = typename D::period;
+			if constexpr (std::chrono::treat_as_floating_point_v<typename D::rep>)
+			{
+				return time_encoding::float_seconds;
+			}
+			else if constexpr (std::ratio_greater_equal_v<period, std::ratio<1>>)
+			{
+				return time_encoding::seconds;
+			}
+			else if constexpr (std::ratio_greater_equal_v<period, std::milli>)
+			{
+				return time_encoding::milliseconds;
+			}
+			else
+			{
+				return time_encoding::nanoseconds;
+			};
+		};
+
+		// Integer targets are rounded to nearest instead of truncated
+		template <typename To, typename From>
+		constexpr To round_duration(const From& _duration) noexcept
+		{
+			if constexpr (std::chrono::treat_as_floating_point_v<typename To::rep>)
+			{
+				return std::chrono::duration_cast<To>(_duration);
+			}
+			else if constexpr (!std::chrono::treat_as_floating_point_v<typename From::rep> &&
+				std::ratio_divide<typename From::period, typename To::period>::den == 1)
+			{
+				// Exact, round would overflow stepping past the largest value
+				return std::chrono::duration_cast<To>(_duration);
+			}
+			else
+			{
+				return std::chrono::round<To>(_duration);
+			};
+		};
+
+		template <typename D>
+		inline void push_duration(state_ptr _lua, const D& _duration, time_encoding _encoding)
+		{
+			switch (_encoding)
+			{
+			case time_encoding::nanoseconds:
+				lua_pushinteger(_lua, static_cast<lua_Integer>(round_duration<std::chrono::nanoseconds>(_duration).count()));
+				break;
+			case time_encoding::milliseconds:
+				lua_pushinteger(_lua, static_cast<lua_Integer>(round_duration<std::chrono::milliseconds>(_duration).count()));
+				break;
+			case time_encoding::seconds:
+				lua_pushinteger(_lua, static_cast<lua_Integer>(round_duration<std::chrono::seconds>(_duration).count()));
+				break;
+			default:
+				lua_pushnumber(_lua, std::chrono::duration<lua_Number>(_duration).count());
+				break;
+			};
+		};
+
+		// Reads a number of _encoding units, integers stay exact and floats are rounded once
+		template <typename D, typename V>
+		inline D make_duration(V _value, time_encoding _encoding) noexcept
+		{
+			switch (_encoding)
+			{
+			case time_encoding::nanoseconds:
+				return round_duration<D>(std::chrono::duration<V, std::nano>(_value));
+			case time_encoding::milliseconds:
+				return round_duration<D>(std::chrono::duration<V, std::milli>(_value));
+			case time_encoding::seconds:
+				[[fallthrough]];
+			default:
+				return round_duration<D>(std::chrono::duration<V>(_value));
+			};
+		};
+
+		/**
+		 * @brief Checks that _value periods of E convert to an integer duration D, rejecting nan and infinities.
+		 *
+		 * Integers are checked exactly, the conversion multiplies before dividing like duration_cast and
+		 * rounding may step one past the truncated value. Floats are checked against powers of two, exact
+		 * as doubles, so values rounding to the upper bound are rejected.
+		*/
+		template <typename D, typename E, typename V>
+		inline bool duration_in_range(V _value) noexcept
+		{
+			using rep = typename D::rep;
+			using factor = std::ratio_divide<E, typename D::period>;
+			if constexpr (std::chrono::treat_as_floating_point_v<rep>)
+			{
+				return true;
+			}
+			else if constexpr (std::is_integral_v<V>)
+			{
+				constexpr auto _max = std::numeric_limits<intmax_t>::max() / factor::num;
+				constexpr auto _min = std::numeric_limits<intmax_t>::min() / factor::num;
+				if (_value > _max || _value < _min)
+				{
+					return false;
+				};
+				const auto _units = static_cast<intmax_t>(_value) * factor::num / factor::den;
+				return (factor::den == 1) ? std::in_range<rep>(_units) : (std::in_range<rep>(_units - 1) && std::in_range<rep>(_units + 1));
+			}
+			else
+			{
+				const auto _units = static_cast<double>(_value) * (static_cast<double>(factor::num) / static_cast<double>(factor::den));
+				constexpr auto _upper = static_cast<double>(uint64_t(1) << (std::numeric_limits<rep>::digits - 1)) * 2.0;
+				constexpr auto _lower = static_cast<double>(std::numeric_limits<rep>::min());
+				return _units >= _lower && _units < _upper;
+			};
+		};
+
+		template <typename D, typename V>
+		inline bool duration_in_range(V _value, time_encoding _encoding) noexcept
+		{
+			switch (_encoding)
+			{
+			case time_encoding::nanoseconds:
+				return duration_in_range<D, std::nano>(_value);
+			case time_encoding::milliseconds:
+				return duration_in_range<D, std::milli>(_value);
+			case time_encoding::seconds:
+				[[fallthrough]];
+			default:
+				return duration_in_range<D, std::ratio<1>>(_value);
+			};
+		};
+
+		template <typename D>
+		inline expected<D, conversion_error> try_to_duration(state_ptr _lua, int _index, time_encoding _encoding)
+		{
+			int _isInteger = 0;
+			const auto _integer = lua_tointegerx(_lua, _index, &_isInteger);
+			if (_isInteger)
+			{
+				if (!duration_in_range<D>(_integer, _encoding))
+				{
+					return conversion_failure(_lua, abs(_lua, _index), conversion_errc::out_of_range, "number");
+				};
+				return make_duration<D>(_integer, _encoding);
+			};
+
+			int _isNumber = 0;
+			const auto _number = lua_tonumberx(_lua, _index, &_isNumber);
+			if (!_isNumber)
+			{
+				return unexpected<conversion_error>(conversion_error{ abs(_lua, _index), conversion_errc::wrong_type, "number", lua_type(_lua, _index) });
+			};
+			if (!duration_in_range<D>(_number, _encoding))
+			{
+				return conversion_failure(_lua, abs(_lua, _index), conversion_errc::out_of_range, "number");
+			};
+			return make_duration<D>(_number, _encoding);
+		};
+	};
+
+	/**
+	 * @brief Stack traits for durations.
+	 *
+	 * Durations are pushed in the encoding given as extra argument, by default float seconds for floating
+	 * point durations and otherwise integer seconds, milliseconds or nanoseconds, whichever is the
+	 * closest to the duration's period. Pulled numbers are read in the same encoding, conversions to
+	 * integer durations round to nearest.
+	 * @code
+	 *	lua::push(_lua, _elapsed, lua::time_encoding::float_seconds);
+	 * @endcode
+	*/
+	template <typename R, typename P>
+	struct stack_traits<std::chrono::duration<R, P>>
+	{
+		using type = std::chrono::duration<R, P>;
+		static constexpr auto default_encoding = impl::default_time_encoding<type>();
+
+		static void push(state_ptr _lua, const type& _value, time_encoding _encoding)
+		{
+			impl::push_duration(_lua, _value, _encoding);
+		};
+		static void push(state_ptr _lua, const type& _value)
+		{
+			impl::push_duration(_lua, _value, default_encoding);
+		};
+		static void to(state_ptr _lua, int _index, type& _value, time_encoding _encoding)
+		{
+			if (const auto _duration = impl::try_to_duration<type>(_lua, _index, _encoding); _duration)
+			{
+				_value = *_duration;
+			};
+		};
+		static void to(state_ptr _lua, int _index, type& _value)
+		{
+			to(_lua, _index, _value, default_encoding);
+		};
+		static expected<type, conversion_error> try_to(state_ptr _lua, int _index)
+		{
+			return impl::try_to_duration<type>(_lua, _index, default_encoding);
+		};
+	};
+
+	/**
+	 * @brief Stack traits for time points, exchanged as their duration since the clock's epoch.
+	 *
+	 * System clock time points pushed with time_encoding::seconds are os.time values.
+	*/
+	template <typename C, typename D>
+	struct stack_traits<std::chrono::time_point<C, D>>
+	{
+		using type = std::chrono::time_point<C, D>;
+		static constexpr auto default_encoding = impl::default_time_encoding<D>();
+
+		static void push(state_ptr _lua, const type& _value, time_encoding _encoding)
+		{
+			impl::push_duration(_lua, _value.time_since_epoch(), _encoding);
+		};
+		static void push(state_ptr _lua, const type& _value)
+		{
+			impl::push_duration(_lua, _value.time_since_epoch(), default_encoding);
+		};
+		static void to(state_ptr _lua, int _index, type& _value, time_encoding _encoding)
+		{
+			if (const auto _duration = impl::try_to_duration<D>(_lua, _index, _encoding); _duration)
+			{
+				_value = type(*_duration);
+			};
+		};
+		static void to(state_ptr _lua, int _index, type& _value)
+		{
+			to(_lua, _index, _value, default_encoding);
+		};
+		static expected<type, conversion_error> try_to(state_ptr _lua, int _index)
+		{
+			auto _duration = impl::try_to_duration<D>(_lua, _index, default_encoding);
+			if (!_duration)
+			{
+				return unexpected<conversion_error>(_duration.error());
+			};
+			return type(*_duration);
+		};
+	};
+
+	/**
+	 * @brief Steady clock with the resolution of the scheduler tick, much cheaper to read than steady_clock.
+	 *
+	 * Reads CLOCK_MONOTONIC_COARSE where available, steady_clock otherwise.
+	*/
+	struct coarse_clock
+	{
+		using duration = std::chrono::nanoseconds;
+		using rep = duration::rep;
+		using period = duration::period;
+		using time_point = std::chrono::time_point<coarse_clock>;
+		static constexpr bool is_steady = true;
+
+		static time_point now() noexcept;
+	};
+
+	/**
+	 * @brief Steady clock reading the CPU's invariant time stamp counter.
+	 *
+	 * The counter is calibrated against the monotonic clock by calibrate, or on first use otherwise. Without
+	 * an invariant TSC, ticks are monotonic clock nanoseconds instead.
+	*/
+	struct tsc_clock
+	{
+		using duration = std::chrono::nanoseconds;
+		using rep = duration::rep;
+		using period = duration::period;
+		using time_point = std::chrono::time_point<tsc_clock>;
+		static constexpr bool is_steady = true;
+
+		/**
+		 * @brief Reads the raw counter.
+		*/
+		static uint64_t ticks() noexcept;
+
+		/**
+		 * @brief Gets the counter frequency in ticks per second.
+		*/
+		static double ticks_per_second() noexcept;
+
+		/**
+		 * @brief Checks if ticks reads the time stamp counter rather than the monotonic clock.
+		*/
+		static bool uses_tsc() noexcept;
+
+		/**
+		 * @brief Calibrates the counter if not done yet, busy waiting for about 10 milliseconds.
+		 *
+		 * Call at startup to keep the calibration out of the first timed reading, open_clock calls it.
+		*/
+		static void calibrate() noexcept;
+
+		static time_point now() noexcept;
+	};
+
+	/**
+	 * @brief Opens the "clock" module, use with luaL_requiref.
+	 *
+	 * clock.monotonic(), clock.coarse() and clock.realtime() return integer nanoseconds, clock.ticks()
+	 * returns the raw tsc_clock counter and clock.tick_rate() its ticks per second and whether it is the TSC.
+	 * Calibrates tsc_clock, see tsc_clock::calibrate.
+	 * @param _lua Lua state.
+	 * @return Number of return values (1, the module table).
+	*/
+	int open_clock(state_ptr _lua);
+};
+#pragma endregion
+
+
+
+/*
+	Container views, exposes C++ containers to lua by reference
+*/
+
+#pragma region CONTAINER_VIEWS
+namespace lua
+{
+	/**
+	 * @brief Owner token used to expire container views pushed to lua.
+	 *
+	 * Views pushed with a lifetime raise a lua error when accessed after the lifetime was
+	 * destroyed or invalidated, instead of reading through a dangling pointer.
+	*/
+	class view_lifetime
+	{
+	public:
+		using token_type = std::weak_ptr<const void>;
+
+		token_type token() const noexcept { return this->token_; };
+
+		/**
+		 * @brief Expires every view created from this lifetime so far.
+		*/
+		void invalidate()
+		{
+			this->token_ = std::make_shared<char>();
+		};
+
+		view_lifetime() :
+			token_(std::make_shared<char>())
+		{};
+
+		view_lifetime(const view_lifetime&) = delete;
+		view_lifetime& operator=(const view_lifetime&) = delete;
+
+	private:
+		std::shared_ptr<const void> token_;
+	};
+
+	namespace impl
+	{
+		template <typename T>
+		struct is_span : std::false_type {};
+		template <typename T, size_t Extent>
+		struct is_span<std::span<T, Extent>> : std::true_type {};
+
+		template <typename T>
+		concept cx_view_map = requires(T& _container, const typename T::key_type& _key)
+		{
+			typename T::mapped_type;
+			_container.find(_key);
+			_container.end();
+			_container.size();
+		};
+
+		template <typename T>
+		concept cx_view_sequence = !cx_view_map<T> && requires(T& _container, size_t _pos)
+		{
+			typename T::value_type;
+			_container[_pos];
+			_container.size();
+		};
+
+		template <typename T>
+		concept cx_viewable =
+			(cx_view_sequence<T> && cx_pushable<const typename T::value_type&>) ||
+			(cx_view_map<T> && cx_pushable<const typename T::key_type&> && cx_pushable<const typename T::mapped_type&>);
+
+		/**
+		 * @brief Checks if the value at a stack index has the lua type a C++ key type is read from.
+		 *
+		 * Prevents lookups from converting mismatched keys, ie. a table key can never find a string entry.
+		*/
+		template <typename T>
+		inline bool view_key_matches(state_ptr _lua, int _index)
+		{
+			if constexpr (std::is_same_v<T, bool>)
+			{
+				return lua_type(_lua, _index) == LUA_TBOOLEAN;
+			}
+			else if constexpr (std::is_integral_v<T>)
+			{
+				// Floats only match integral keys they are equal to, like table keys
+				int _isInteger = 0;
+				const auto _value = lua_tointegerx(_lua, _index, &_isInteger);
+				return lua_type(_lua, _index) == LUA_TNUMBER && _isInteger && in_integer_range<T>(_value);
+			}
+			else if constexpr (std::is_arithmetic_v<T>)
+			{
+				return lua_type(_lua, _index) == LUA_TNUMBER;
+			}
+			else if constexpr (std::is_constructible_v<std::string_view, const T&>)
+			{
+				return lua_type(_lua, _index) == LUA_TSTRING;
+			}
+			else
+			{
+				return true;
+			};
+		};
+
+		/**
+		 * @brief Converts a value assigned through a view, raising an argument error if it does not convert.
+		*/
+		template <typename T>
+		inline void to_view_value(state_ptr _lua, int _index, T& _value)
+		{
+			if constexpr (cx_try_pullable<T>)
+			{
+				// The error is raised once the converted value is destroyed
+				auto _error = std::optional<conversion_error>{};
+				{
+					auto _result = try_to<T>(_lua, _index);
+					if (_result)
+					{
+						_value = std::move(*_result);
+					}
+					else
+					{
+						_error = _result.error();
+					};
+				};
+				if (_error)
+				{
+					raise_argument_errors(_lua, &*_error, 1);
+				};
+			}
+			else
+			{
+				lua::to(_lua, _index, _value);
+			};
+		};
+
+		/**
+		 * @brief Common header of every container view userdata.
+		*/
+		struct view_base
+		{
+			std::weak_ptr<const void> token;
+			bool tracked = false;
+
+			bool expired() const noexcept
+			{
+				return this->tracked && this->token.expired();
+			};
+		};
+
+		template <typename ContainerT>
+		struct container_view : public view_base
+		{
+			using container_type = ContainerT;
+
+			// Spans are views themselves so they are stored by value.
+			using storage_type = std::conditional_t<is_span<ContainerT>::value, ContainerT, ContainerT*>;
+			storage_type ref;
+
+			container_type& get() noexcept
+			{
+				if constexpr (is_span<ContainerT>::value)
+				{
+					return this->ref;
+				}
+				else
+				{
+					return *this->ref;
+				};
+			};
+		};
+
+		/**
+		 * @brief Tag type keying the metatable of views that own their container.
+		*/
+		template <typename ContainerT>
+		struct owned_container_view_tag {};
+
+		// Gets a view of ContainerT, owned or not, or nullptr if the value is something else
+		template <typename ContainerT>
+		inline container_view<ContainerT>* test_view(state_ptr _lua, int _index)
+		{
+			if (const auto _view = testudata<container_view<ContainerT>>(_lua, _index))
+			{
+				return _view;
+			};
+			return static_cast<container_view<ContainerT>*>(static_cast<void*>(
+				testudata<owned_container_view_tag<ContainerT>>(_lua, _index)));
+		};
+
+		template <typename ContainerT>
+		inline container_view<ContainerT>& check_view(state_ptr _lua, int _index)
+		{
+			const auto _view = test_view<ContainerT>(_lua, _index);
+			if (!_view)
+			{
+				luaL_typeerror(_lua, _index, "view");
+			};
+			if (_view->expired())
+			{
+				luaL_error(_lua, "attempt to access an expired view");
+			};
+			return *_view;
+		};
+
+		template <typename ContainerT>
+		struct view_sequence_ops
+		{
+			using value_type = typename ContainerT::value_type;
+			using reference = decltype(std::declval<ContainerT&>()[0]);
+
+			static constexpr bool is_writable = std::is_assignable_v<reference, const value_type&>;
+			static constexpr bool is_growable = is_writable &&
+				requires(ContainerT& _container, value_type&& _value) { _container.push_back(std::move(_value)); };
+
+			static int index(state_ptr _lua)
+			{
+				auto& _container = check_view<ContainerT>(_lua, 1).get();
+
+				int _isInteger = 0;
+				const auto _key = lua_tointegerx(_lua, 2, &_isInteger);
+				if (_isInteger && _key >= 1 && static_cast<lua_Unsigned>(_key) <= _container.size())
+				{
+					lua::push(_lua, static_cast<const value_type&>(_container[static_cast<size_t>(_key - 1)]));
+				}
+				else
+				{
+					lua_pushnil(_lua);
+				};
+				return 1;
+			};
+
+			static int newindex(state_ptr _lua)
+			{
+				if constexpr (!is_writable)
+				{
+					return luaL_error(_lua, "attempt to modify a read-only view");
+				}
+				else
+				{
+					auto& _container = check_view<ContainerT>(_lua, 1).get();
+					const auto _size = static_cast<lua_Unsigned>(_container.size());
+
+					// Assigning one past the end appends when the container can grow.
+					int _isInteger = 0;
+					const auto _key = lua_tointegerx(_lua, 2, &_isInteger);
+					if (!_isInteger || _key < 1 || static_cast<lua_Unsigned>(_key) > _size + (is_growable ? 1 : 0))
+					{
+						return luaL_error(_lua, "view index out of range");
+					};
+
+					const auto _pos = static_cast<size_t>(_key - 1);
+					if constexpr (is_growable)
+					{
+						if (_pos == _size)
+						{
+							auto _value = value_type{};
+							to_view_value(_lua, 3, _value);
+							_container.push_back(std::move(_value));
+							return 0;
+						};
+					};
+
+					if constexpr (std::is_same_v<reference, value_type&>)
+					{
+						to_view_value(_lua, 3, _container[_pos]);
+					}
+					else
+					{
+						auto _value = value_type{};
+						to_view_value(_lua, 3, _value);
+						_container[_pos] = _value;
+					};
+					return 0;
+				};
+			};
+
+			static int len(state_ptr _lua)
+			{
+				const auto& _container = check_view<ContainerT>(_lua, 1).get();
+				lua_pushinteger(_lua, static_cast<lua_Integer>(_container.size()));
+				return 1;
+			};
+
+			static int next(state_ptr _lua)
+			{
+				auto& _container = check_view<ContainerT>(_lua, 1).get();
+
+				// Previous key is the 1-based index, so it is also the 0-based position of the next element
+				const auto _pos = static_cast<size_t>(luaL_optinteger(_lua, 2, 0));
+				if (_pos >= _container.size())
+				{
+					lua_pushnil(_lua);
+					return 1;
+				};
+
+				lua_pushinteger(_lua, static_cast<lua_Integer>(_pos + 1));
+				lua::push(_lua, static_cast<const value_type&>(_container[_pos]));
+				return 2;
+			};
+		};
+
+		template <typename ContainerT>
+		struct view_map_ops
+		{
+			using key_type = typename ContainerT::key_type;
+			using mapped_type = typename ContainerT::mapped_type;
+
+			static constexpr bool is_writable = !std::is_const_v<ContainerT>;
+
+			// Finds the entry for the key at a stack index, returns end() when the key can never match.
+			static auto find(state_ptr _lua, ContainerT& _container, int _index)
+			{
+				if (!view_key_matches<key_type>(_lua, _index))
+				{
+					return _container.end();
+				};
+
+				// Avoid building a key string when the container supports heterogeneous lookup.
+				if constexpr (requires { _container.find(std::declval<std::string_view>()); })
+				{
+					size_t _len = 0;
+					const auto _str = lua_tolstring(_lua, _index, &_len);
+					return _container.find(std::string_view(_str, _len));
+				}
+				else
+				{
+					auto _key = key_type{};
+					lua::to(_lua, _index, _key);
+					return _container.find(_key);
+				};
+			};
+
+			static int index(state_ptr _lua)
+			{
+				auto& _container = check_view<ContainerT>(_lua, 1).get();
+				const auto it = find(_lua, _container, 2);
+				if (it != _container.end())
+				{
+					lua::push(_lua, static_cast<const mapped_type&>(it->second));
+				}
+				else
+				{
+					lua_pushnil(_lua);
+				};
+				return 1;
+			};
+
+			static int newindex(state_ptr _lua)
+			{
+				if constexpr (!is_writable)
+				{
+					return luaL_error(_lua, "attempt to modify a read-only view");
+				}
+				else
+				{
+					auto& _container = check_view<ContainerT>(_lua, 1).get();
+					if (!view_key_matches<key_type>(_lua, 2))
+					{
+						return luaL_error(_lua, "invalid view key type (%s)", luaL_typename(_lua, 2));
+					};
+
+					// Assigning nil erases the entry
+					const auto it = find(_lua, _container, 2);
+					if (lua_isnil(_lua, 3))
+					{
+						if (it != _container.end())
+						{
+							_container.erase(it);
+						};
+					}
+					else if (it != _container.end())
+					{
+						to_view_value(_lua, 3, it->second);
+					}
+					else
+					{
+						auto _value = mapped_type{};
+						to_view_value(_lua, 3, _value);
+						auto _key = key_type{};
+						lua::to(_lua, 2, _key);
+						_container.insert_or_assign(std::move(_key), std::move(_value));
+					};
+					return 0;
+				};
+			};
+
+			static int len(state_ptr _lua)
+			{
+				const auto& _container = check_view<ContainerT>(_lua, 1).get();
+				lua_pushinteger(_lua, static_cast<lua_Integer>(_container.size()));
+				return 1;
+			};
+
+			/*
+				(view, key) -> key, value | nil
+
+				Upvalues are the last key returned and the key following it, or nil at the end, so that the
+				traversal can resume when the entry of the last key was erased by the loop.
+			*/
+			static int next(state_ptr _lua)
+			{
+				auto& _container = check_view<ContainerT>(_lua, 1).get();
+				lua_settop(_lua, 2);
+
+				// Resume after the previous key, lookups keep this valid across modifications of other entries
+				auto it = _container.begin();
+				if (!lua_isnil(_lua, 2))
+				{
+					it = find(_lua, _container, 2);
+					if (it != _container.end())
+					{
+						++it;
+					}
+					else if (!lua_rawequal(_lua, 2, lua_upvalueindex(1)))
+					{
+						return luaL_error(_lua, "invalid key to 'next'");
+					}
+					else if (!lua_isnil(_lua, lua_upvalueindex(2)))
+					{
+						copy(_lua, lua_upvalueindex(2));
+						it = find(_lua, _container, -1);
+						if (it == _container.end())
+						{
+							return luaL_error(_lua, "invalid key to 'next'");
+						};
+					};
+				};
+
+				if (it == _container.end())
+				{
+					lua_pushnil(_lua);
+					return 1;
+				};
+
+				lua::push(_lua, static_cast<const key_type&>(it->first));
+				lua::push(_lua, static_cast<const mapped_type&>(it->second));
+
+				copy(_lua, -2);
+				lua_replace(_lua, lua_upvalueindex(1));
+				if (const auto _following = std::next(it); _following != _container.end())
+				{
+					lua::push(_lua, static_cast<const key_type&>(_following->first));
+				}
+				else
+				{
+					lua_pushnil(_lua);
+				};
+				lua_replace(_lua, lua_upvalueindex(2));
+				return 2;
+			};
+		};
+
+		template <typename ContainerT>
+		struct view_ops : public std::conditional_t<cx_view_map<ContainerT>,
+			view_map_ops<ContainerT>, view_sequence_ops<ContainerT>>
+		{
+			using base_type = std::conditional_t<cx_view_map<ContainerT>,
+				view_map_ops<ContainerT>, view_sequence_ops<ContainerT>>;
+
+			static int pairs(state_ptr _lua)
+			{
+				check_view<ContainerT>(_lua, 1);
+				if constexpr (cx_view_map<ContainerT>)
+				{
+					// Each traversal gets its own closure so nested loops keep separate cursors
+					lua_pushnil(_lua);
+					lua_pushnil(_lua);
+					lua_pushcclosure(_lua, &base_type::next, 2);
+				}
+				else
+				{
+					lua_pushcfunction(_lua, &base_type::next);
+				};
+				lua_pushvalue(_lua, 1);
+				lua_pushnil(_lua);
+				return 3;
+			};
+
+			static int gc(state_ptr _lua)
+			{
+				const auto _view = testudata<container_view<ContainerT>>(_lua, 1);
+				if (!_view)
+				{
+					return luaL_typeerror(_lua, 1, "view");
+				};
+				std::destroy_at(_view);
+
+				// Removing the metatable marks the view as destroyed, any later use fails the type checks
+				lua_pushnil(_lua);
+				lua_setmetatable(_lua, 1);
+				return 0;
+			};
+
+			static void init_metatable(state_ptr _lua, int _metatableIndex)
+			{
+				lua_pushcfunction(_lua, &base_type::index);
+				lua_setfield(_lua, _metatableIndex, "__index");
+				lua_pushcfunction(_lua, &base_type::newindex);
+				lua_setfield(_lua, _metatableIndex, "__newindex");
+				lua_pushcfunction(_lua, &base_type::len);
+				lua_setfield(_lua, _metatableIndex, "__len");
+				lua_pushcfunction(_lua, &pairs);
+				lua_setfield(_lua, _metatableIndex, "__pairs");
+				lua_pushcfunction(_lua, &gc);
+				lua_setfield(_lua, _metatableIndex, "__gc");
+				lua_pushliteral(_lua, "view");
+				lua_setfield(_lua, _metatableIndex, "__name");
+
+				// Scripts may not swap out the metamethods, they assume the userdata layout.
+				lua_pushboolean(_lua, false);
+				lua_setfield(_lua, _metatableIndex, "__metatable");
+			};
+		};
+
+		template <typename ContainerT>
+		inline void push_container_view(state_ptr _lua, ContainerT& _container, const view_lifetime* _lifetime)
+		{
+			using view_type = container_view<ContainerT>;
+
+			auto _view = new (newuserdata(_lua, sizeof(view_type), 0)) view_type{};
+			if constexpr (is_span<ContainerT>::value)
+			{
+				_view->ref = _container;
+			}
+			else
+			{
+				_view->ref = &_container;
+			};
+			if (_lifetime)
+			{
+				_view->token = _lifetime->token();
+				_view->tracked = true;
+			};
+
+			get_or_create_metatable<view_type>(_lua, &view_ops<ContainerT>::init_metatable);
+			setmetatable(_lua, -2);
+		};
+
+		// Owned views store the container right after the view header in the same userdata.
+		template <typename ContainerT>
+		constexpr size_t owned_container_offset() noexcept
+		{
+			constexpr auto _align = alignof(ContainerT);
+			return (sizeof(container_view<ContainerT>) + _align - 1) / _align * _align;
+		};
+
+		template <typename ContainerT>
+		struct owned_view_ops : public view_ops<ContainerT>
+		{
+			static int gc(state_ptr _lua)
+			{
+				const auto _view = static_cast<container_view<ContainerT>*>(static_cast<void*>(
+					testudata<owned_container_view_tag<ContainerT>>(_lua, 1)));
+				if (!_view)
+				{
+					return luaL_typeerror(_lua, 1, "view");
+				};
+				std::destroy_at(_view->ref);
+				std::destroy_at(_view);
+
+				lua_pushnil(_lua);
+				lua_setmetatable(_lua, 1);
+				return 0;
+			};
+
+			static void init_metatable(state_ptr _lua, int _metatableIndex)
+			{
+				view_ops<ContainerT>::init_metatable(_lua, _metatableIndex);
+				lua_pushcfunction(_lua, &gc);
+				lua_setfield(_lua, _metatableIndex, "__gc");
+			};
+		};
+	};
+
+	/**
+	 * @brief Pushes a typed array, a view which owns its vector of elements.
+	 *
+	 * Behaves exactly like a view pushed with push_view, but the elements live inside the userdata
+	 * and are freed with it.
+	 *
+	 * @param _lua Lua state.
+	 * @param _values Elements of the array.
+	 * @return The vector owned by the userdata, valid while the userdata is alive.
+	*/
+	template <typename T, typename Alloc>
+	requires impl::cx_viewable<std::vector<T, Alloc>>
+	inline std::vector<T, Alloc>& push_array(state_ptr _lua, std::vector<T, Alloc> _values)
+	{
+		using container_type = std::vector<T, Alloc>;
+		using view_type = impl::container_view<container_type>;
+
+		constexpr auto _offset = impl::owned_container_offset<container_type>();
+		const auto _memory = static_cast<std::byte*>(newuserdata(_lua, _offset + sizeof(container_type), 0));
+
+		auto _view = new (_memory) view_type{};
+		_view->ref = new (_memory + _offset) container_type(std::move(_values));
+
+		get_or_create_metatable<impl::owned_container_view_tag<container_type>>(_lua,
+			&impl::owned_view_ops<container_type>::init_metatable);
+		setmetatable(_lua, -2);
+		return *_view->ref;
+	};
+
+	/**
+	 * @brief Pushes a userdata that reads and writes through to a C++ container instead of copying it.
+	 *
+	 * Sequences (vector, deque, span, ...) are indexed 1-based, assigning one past the end appends
+	 * when the container supports push_back. Maps are indexed by key and assigning nil erases.
+	 * Both support #, pairs and ipairs.
+	 *
+	 * The caller must keep the container alive for as long as lua can reach the view, use the
+	 * overload taking a view_lifetime when that cannot be guaranteed.
+	 *
+	 * @param _lua Lua state.
+	 * @param _container Container to view, const containers produce read-only views.
+	*/
+	template <typename ContainerT>
+	requires impl::cx_viewable<ContainerT>
+	inline void push_view(state_ptr _lua, ContainerT& _container)
+	{
+		impl::push_container_view(_lua, _container, nullptr);
+	};
+
+	/**
+	 * @brief Pushes a view of a C++ container which raises an error once the lifetime expires.
+	 * @param _lua Lua state.
+	 * @param _container Container to view, const containers produce read-only views.
+	 * @param _lifetime Lifetime token of the container.
+	*/
+	template <typename ContainerT>
+	requires impl::cx_viewable<ContainerT>
+	inline void push_view(state_ptr _lua, ContainerT& _container, const view_lifetime& _lifetime)
+	{
+		impl::push_container_view(_lua, _container, &_lifetime);
+	};
+
+	/**
+	 * @brief Pushes a view of the elements referenced by a span.
+	 * @param _lua Lua state.
+	 * @param _span Span to view, spans of const elements produce read-only views.
+	*/
+	template <typename T, size_t Extent>
+	requires impl::cx_viewable<std::span<T, Extent>>
+	inline void push_view(state_ptr _lua, std::span<T, Extent> _span)
+	{
+		impl::push_container_view(_lua, _span, nullptr);
+	};
+
+	/**
+	 * @brief Pushes a view of the elements referenced by a span which raises an error once the lifetime expires.
+	 * @param _lua Lua state.
+	 * @param _span Span to view, spans of const elements produce read-only views.
+	 * @param _lifetime Lifetime token of the viewed elements.
+	*/
+	template <typename T, size_t Extent>
+	requires impl::cx_viewable<std::span<T, Extent>>
+	inline void push_view(state_ptr _lua, std::span<T, Extent> _span, const view_lifetime& _lifetime)
+	{
+		impl::push_container_view(_lua, _span, &_lifetime);
+	};
+
+};
+#pragma endregion
+
+
+
+/*
+	Range iterators, exposes C++ ranges to lua's generic for loop
+*/
+
+#pragma region RANGE_ITERATORS
+namespace lua
+{
+	namespace impl
+	{
+		template <typename ViewT>
+		struct range_iterator_state
+		{
+			// Empty once closed by __gc, the userdata itself stays valid as the closure may still run.
+			std::optional<ViewT> view;
+
+			// Empty until the first step, input ranges may only have begin() called once.
+			std::optional<std::ranges::iterator_t<ViewT>> it;
+
+			bool done = false;
+
+			explicit range_iterator_state(ViewT&& _view) :
+				view(std::in_place, std::move(_view))
+			{};
+
+			void close()
+			{
+				this->done = true;
+				this->it.reset();
+				this->view.reset();
+			};
+		};
+
+		template <typename ViewT>
+		struct range_iterator_ops
+		{
+			using state_type = range_iterator_state<ViewT>;
+
+			static int step(state_ptr _lua)
+			{
+				auto& _state = *static_cast<state_type*>(lua_touserdata(_lua, lua_upvalueindex(1)));
+				if (_state.done)
+				{
+					lua_pushnil(_lua);
+					return 1;
+				};
+
+				// Advance lazily so the previous element stays valid while the loop body runs.
+				if (!_state.it)
+				{
+					_state.it.emplace(std::ranges::begin(*_state.view));
+				}
+				else
+				{
+					++*_state.it;
+				};
+
+				if (*_state.it == std::ranges::end(*_state.view))
+				{
+					_state.done = true;
+					lua_pushnil(_lua);
+					return 1;
+				};
+
+				const auto _top = top(_lua);
+				lua::push(_lua, **_state.it);
+				return top(_lua) - _top;
+			};
+
+			static int gc(state_ptr _lua)
+			{
+				const auto _state = testudata<state_type>(_lua, 1);
+				if (!_state)
+				{
+					return luaL_typeerror(_lua, 1, "iterator");
+				};
+				_state->close();
+				return 0;
+			};
+
+			static void init_metatable(state_ptr _lua, int _metatableIndex)
+			{
+				lua_pushcfunction(_lua, &gc);
+				lua_setfield(_lua, _metatableIndex, "__gc");
+				lua_pushliteral(_lua, "iterator");
+				lua_setfield(_lua, _metatableIndex, "__name");
+				lua_pushboolean(_lua, false);
+				lua_setfield(_lua, _metatableIndex, "__metatable");
+			};
+		};
+	};
+
+	/**
+	 * @brief Pushes an iterator function for a C++ range, usable directly by lua's generic for loop.
+	 *
+	 * Elements are converted with stack_traits one at a time as the loop advances, no table is built.
+	 * Lvalue ranges are referenced and must outlive the iterator, rvalue ranges are moved into it.
+	 *
+	 * @param _lua Lua state.
+	 * @param _range Input range to iterate, its elements must be pushable.
+	*/
+	template <typename RangeT>
+	requires std::ranges::input_range<RangeT> && std::ranges::viewable_range<RangeT> &&
+		cx_pushable<std::ranges::range_reference_t<std::views::all_t<RangeT>>>
+	inline void push_iterator(state_ptr _lua, RangeT&& _range)
+	{
+		using view_type = std::views::all_t<RangeT>;
+		using state_type = impl::range_iterator_state<view_type>;
+		using ops_type = impl::range_iterator_ops<view_type>;
+
+		new (newuserdata(_lua, sizeof(state_type), 0)) state_type(std::views::all(std::forward<RangeT>(_range)));
+		if constexpr (!std::is_trivially_destructible_v<state_type>)
+		{
+			get_or_create_metatable<state_type>(_lua, &ops_type::init_metatable);
+			setmetatable(_lua, -2);
+		};
+		lua_pushcclosure(_lua, &ops_type::step, 1);
+	};
+
+};
+#pragma endregion
+
+
+
+/*
+	Read-only byte views over memory owned outside of lua
+*/
+
+#pragma region BYTES
+namespace lua
+{
+	namespace impl
+	{
+		/**
+		 * @brief Reverses the byte order of an integral or floating point value.
+		*/
+		template <typename T>
+		requires std::is_arithmetic_v<T>
+		constexpr T byteswap(T _value) noexcept
+		{
+			using bits_type = std::conditional_t<sizeof(T) == 1, uint8_t,
+				std::conditional_t<sizeof(T) == 2, uint16_t,
+				std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>>>;
+			static_assert(sizeof(bits_type) == sizeof(T));
+
+			auto _bits = std::bit_cast<bits_type>(_value);
+			auto _swapped = bits_type(0);
+			for (size_t n = 0; n != sizeof(T); ++n)
+			{
+				_swapped = static_cast<bits_type>((_swapped << 8) | (_bits & 0xFF));
+				_bits = static_cast<bits_type>(_bits >> 8);
+			};
+			return std::bit_cast<T>(_swapped);
+		};
+
+		/**
+		 * @brief Reads a possibly unaligned value stored with the given byte order.
+		*/
+		template <typename T>
+		inline T load_bytes(const std::byte* _data, std::endian _order) noexcept
+		{
+			auto _value = T{};
+			std::memcpy(&_value, _data, sizeof(T));
+			return (_order == std::endian::native) ? _value : byteswap(_value);
+		};
+
+		/**
+		 * @brief Writes a possibly unaligned value with the given byte order.
+		*/
+		template <typename T>
+		inline void store_bytes(std::byte* _data, T _value, std::endian _order) noexcept
+		{
+			if (_order != std::endian::native)
+			{
+				_value = byteswap(_value);
+			};
+			std::memcpy(_data, &_value, sizeof(T));
+		};
+	};
+
+	/**
+	 * @brief Read-only view of memory owned outside of lua, pushed as a "bytes" userdata.
+	*/
+	struct byte_view
+	{
+		/**
+		 * @brief First viewed byte.
+		*/
+		const std::byte* data = nullptr;
+
+		/**
+		 * @brief Number of viewed bytes.
+		*/
+		size_t size = 0;
+
+		/**
+		 * @brief Keeps the viewed memory alive, left empty when the caller guarantees its lifetime.
+		*/
+		std::shared_ptr<const void> owner{};
+
+		std::string_view str() const noexcept
+		{
+			return std::string_view(reinterpret_cast<const char*>(this->data), this->size);
+		};
+	};
+
+	/**
+	 * @brief Maps a file into memory as a read-only byte view.
+	 * @param _path Path to the file.
+	 * @param _outView Set to the mapping on success, the mapping lives as long as the view's owner.
+	 * @return True on success, false on failure with errno set.
+	*/
+	bool map_file(const char* _path, byte_view& _outView);
+
+	/**
+	 * @brief Pushes a "bytes" userdata viewing the given memory, the bytes are never copied.
+	 * @param _lua Lua state.
+	 * @param _view Memory to view.
+	*/
+	void push_bytes(state_ptr _lua, byte_view _view);
+
+	/**
+	 * @brief Gets the byte view of a "bytes" userdata.
+	 * @param _lua Lua state.
+	 * @param _index Index of the value.
+	 * @return The view, or nullptr if the value is not a "bytes" userdata.
+	*/
+	const byte_view* tobytes(state_ptr _lua, int _index);
+
+	/**
+	 * @brief Opens the "bytes" module, use with luaL_requiref.
+	 * @param _lua Lua state.
+	 * @return Number of return values (1, the module table).
+	*/
+	int open_bytes(state_ptr _lua);
+
+	/**
+	 * @brief Stack traits type for byte views.
+	 *
+	 * Views pulled from a "bytes" userdata wrapping a lua string are only valid while that userdata is alive.
+	*/
+	template <>
+	struct stack_traits<byte_view>
+	{
+		using type = byte_view;
+		static void push(state_ptr _lua, const type& _value)
+		{
+			push_bytes(_lua, _value);
+		};
+		static void to(state_ptr _lua, int _index, type& _value)
+		{
+			const auto _view = tobytes(_lua, _index);
+			_value = (_view) ? *_view : type{};
+		};
+	};
+
+};
+#pragma endregion
+
+
+
+/*
+	Mutable byte buffers with shared storage slices
+*/
+
+#pragma region BYTE_BUFFERS
+namespace lua
+{
+	/**
+	 * @brief Window into growable byte storage, pushed as a "buffer" userdata.
+	 *
+	 * Slices share the storage of the buffer they were taken from, so writes through either are
+	 * visible in both. Only whole (non-slice) buffers can grow.
+	*/
+	struct byte_buffer
+	{
+		using storage_type = std::vector<std::byte>;
+
+		/**
+		 * @brief Length value of a whole buffer, which always spans the full storage.
+		*/
+		static constexpr size_t npos = static_cast<size_t>(-1);
+
+		std::shared_ptr<storage_type> storage{};
+		size_t offset = 0;
+		size_t length = npos;
+
+		bool is_slice() const noexcept
+		{
+			return this->length != npos;
+		};
+
+		/**
+		 * @brief Gets the bytes of the buffer, invalidated by the next append to the storage.
+		*/
+		std::span<std::byte> span() const noexcept
+		{
+			if (!this->storage)
+			{
+				return {};
+			};
+
+			auto& _bytes = *this->storage;
+			if (!this->is_slice())
+			{
+				return std::span<std::byte>(_bytes.data(), _bytes.size());
+			};
+
+			// Clamp, the storage may have been cleared after the slice was taken
+			const auto _begin = std::min(this->offset, _bytes.size());
+			const auto _end = std::min(this->offset + this->length, _bytes.size());
+			return std::span<std::byte>(_bytes.data() + _begin, _end - _begin);
+		};
+	};
+
+	/**
+	 * @brief Pushes a "buffer" userdata.
+	 * @param _lua Lua state.
+	 * @param _buffer Buffer to push, creates new storage if it has none.
+	*/
+	void push_buffer(state_ptr _lua, byte_buffer _buffer);
+
+	/**
+	 * @brief Gets the byte buffer of a "buffer" userdata.
+	 * @param _lua Lua state.
+	 * @param _index Index of the value.
+	 * @return The buffer, or nullptr if the value is not a "buffer" userdata.
+	*/
+	byte_buffer* tobuffer(state_ptr _lua, int _index);
+
+	/**
+	 * @brief Opens the "buffer" module, use with luaL_requiref.
+	 * @param _lua Lua state.
+	 * @return Number of return values (1, the module table).
+	*/
+	int open_buffer(state_ptr _lua);
+
+	/**
+	 * @brief Stack traits type for byte buffers, pulled buffers share storage with the lua value.
+	*/
+	template <>
+	struct stack_traits<byte_buffer>
+	{
+		using type = byte_buffer;
+		static void push(state_ptr _lua, const type& _value)
+		{
+			push_buffer(_lua, _value);
+		};
+		static void to(state_ptr _lua, int _index, type& _value)
+		{
+			const auto _buffer = tobuffer(_lua, _index);
+			_value = (_buffer) ? *_buffer : type{};
+		};
+	};
+
+};
+#pragma endregion
+
+
+
+/*
+	Span arguments, read lua strings, typed arrays and buffers in place
+*/
+
+#pragma region SPAN_ARGUMENTS
+namespace lua
+{
+	namespace impl
+	{
+		template <typename T>
+		concept cx_byte_like = sizeof(T) == 1 && !std::is_same_v<std::remove_cv_t<T>, bool> &&
+			(std::is_same_v<std::remove_cv_t<T>, std::byte> || std::is_integral_v<T>);
+
+		// Elements which can be read from the raw bytes of buffers
+		template <typename T>
+		concept cx_plain_element = cx_byte_like<T> || std::is_arithmetic_v<T>;
+
+		/**
+		 * @brief Views bytes as elements, if they are aligned for them and a whole number of them.
+		*/
+		template <typename T, typename ByteT>
+		inline std::optional<std::span<T>> span_of_bytes(std::span<ByteT> _bytes) noexcept
+		{
+			const auto _address = reinterpret_cast<std::uintptr_t>(_bytes.data());
+			if (_address % alignof(T) != 0 || _bytes.size() % sizeof(T) != 0)
+			{
+				return std::nullopt;
+			};
+			return std::span<T>(reinterpret_cast<T*>(_bytes.data()), _bytes.size() / sizeof(T));
+		};
+
+		/**
+		 * @brief Finds the elements of a typed array, see push_array, or of a container view of a vector or span.
+		*/
+		template <typename T>
+		inline expected<std::span<T>, conversion_error> typed_array_span(state_ptr _lua, int _index, int _metatable, bool& _found)
+		{
+			using element_type = std::remove_const_t<T>;
+			using vector_type = std::vector<element_type>;
+
+			const auto _matches = [_lua, _metatable](void* _key)
+			{
+				rawget(_lua, LUA_REGISTRYINDEX, _key);
+				const bool _equal = lua_rawequal(_lua, -1, _metatable) != 0;
+				pop(_lua);
+				return _equal;
+			};
+			const auto _check = [_lua, _index]<typename ContainerT>(std::type_identity<ContainerT>) -> expected<std::span<T>, conversion_error>
+			{
+				auto& _view = *static_cast<container_view<ContainerT>*>(lua_touserdata(_lua, _index));
+				if (_view.expired())
+				{
+					return conversion_failure(_lua, _index, conversion_errc::expired, "array");
+				};
+				auto& _container = _view.get();
+				return std::span<T>(_container.data(), _container.size());
+			};
+
+			_found = true;
+			if (_matches(type_key<owned_container_view_tag<vector_type>>()) || _matches(type_key<container_view<vector_type>>()))
+			{
+				return _check(std::type_identity<vector_type>{});
+			};
+			if (_matches(type_key<container_view<std::span<element_type>>>()))
+			{
+				return _check(std::type_identity<std::span<element_type>>{});
+			};
+			if constexpr (std::is_const_v<T>)
+			{
+				if (_matches(type_key<container_view<const vector_type>>()))
+				{
+					return _check(std::type_identity<const vector_type>{});
+				};
+				if (_matches(type_key<container_view<std::span<const element_type>>>()))
+				{
+					return _check(std::type_identity<std::span<const element_type>>{});
+				};
+			};
+			_found = false;
+			return conversion_failure(_lua, _index, conversion_errc::wrong_type, "array");
+		};
+
+		template <typename T>
+		constexpr const char* span_type_name() noexcept
+		{
+			if constexpr (std::is_const_v<T> && cx_byte_like<T>)
+			{
+				return "string, bytes, buffer or array";
+			}
+			else if constexpr (std::is_const_v<T> && cx_plain_element<T>)
+			{
+				return "bytes, buffer or array";
+			}
+			else if constexpr (cx_plain_element<T>)
+			{
+				return "buffer or array";
+			}
+			else
+			{
+				return "array";
+			};
+		};
+
+		/**
+		 * @brief Gets a span over the elements of a lua value without copying them.
+		 *
+		 * Typed arrays and views of vectors or spans of the element type are always accepted. Buffers are
+		 * accepted for arithmetic elements when their bytes are aligned for them, bytes userdata and
+		 * strings only for spans of const elements, strings only for single byte elements.
+		*/
+		template <typename T>
+		inline expected<std::span<T>, conversion_error> try_to_span(state_ptr _lua, int _index)
+		{
+			_index = abs(_lua, _index);
+			const auto _type = lua_type(_lua, _index);
+			if constexpr (std::is_const_v<T> && cx_byte_like<T>)
+			{
+				if (_type == LUA_TSTRING)
+				{
+					size_t _len = 0;
+					const auto _str = lua_tolstring(_lua, _index, &_len);
+					return std::span<T>(reinterpret_cast<T*>(_str), _len);
+				};
+			};
+			if (_type != LUA_TUSERDATA || !lua_getmetatable(_lua, _index))
+			{
+				return conversion_failure(_lua, _index, conversion_errc::wrong_type, span_type_name<T>());
+			};
+
+			const auto _metatable = top(_lua);
+			bool _found = false;
+			auto _span = typed_array_span<T>(_lua, _index, _metatable, _found);
+			pop(_lua);
+			if (_found)
+			{
+				return _span;
+			};
+
+			if constexpr (cx_plain_element<T>)
+			{
+				auto _bytes = std::optional<std::span<T>>{};
+				if (const auto _buffer = tobuffer(_lua, _index); _buffer)
+				{
+					_bytes = span_of_bytes<T>(_buffer->span());
+				}
+				else if constexpr (std::is_const_v<T>)
+				{
+					const auto _view = tobytes(_lua, _index);
+					if (!_view)
+					{
+						return conversion_failure(_lua, _index, conversion_errc::wrong_type, span_type_name<T>());
+					};
+					_bytes = span_of_bytes<T>(std::span<const std::byte>(_view->data, _view->size));
+				}
+				else
+				{
+					return conversion_failure(_lua, _index, conversion_errc::wrong_type, span_type_name<T>());
+				};
+
+				if (!_bytes)
+				{
+					return conversion_failure(_lua, _index, conversion_errc::misaligned, span_type_name<T>());
+				};
+				return *_bytes;
+			}
+			else
+			{
+				return conversion_failure(_lua, _index, conversion_errc::wrong_type, span_type_name<T>());
+			};
+		};
+
+		/**
+		 * @brief Checks if a userdata is of a kind try_to_span takes for spans of T, ignoring alignment and expiry.
+		*/
+		template <typename T>
+		inline bool is_span_source(state_ptr _lua, int _index)
+		{
+			_index = abs(_lua, _index);
+			if (!lua_getmetatable(_lua, _index))
+			{
+				return false;
+			};
+			bool _found = false;
+			(void)typed_array_span<T>(_lua, _index, top(_lua), _found);
+			pop(_lua);
+			if (_found)
+			{
+				return true;
+			};
+
+			if constexpr (cx_plain_element<T>)
+			{
+				if (tobuffer(_lua, _index))
+				{
+					return true;
+				};
+				if constexpr (std::is_const_v<T>)
+				{
+					return tobytes(_lua, _index) != nullptr;
+				};
+			};
+			return false;
+		};
+	};
+
+	/**
+	 * @brief Stack traits type for spans, reads strings, typed arrays and buffers without copying.
+	 *
+	 * Spans of buffers are invalidated by the next append to the buffer, spans of strings, bytes and
+	 * typed arrays are valid while the lua value is alive. Tables are refused, use span_or_copy to
+	 * accept them. Values that cannot be viewed give an empty span.
+	*/
+	template <typename T>
+	struct stack_traits<std::span<T>>
+	{
+		using type = std::span<T>;
+		static void to(state_ptr _lua, int _index, type& _value)
+		{
+			_value = impl::try_to_span<T>(_lua, _index).value_or(type{});
+		};
+		static expected<type, conversion_error> try_to(state_ptr _lua, int _index)
+		{
+			return impl::try_to_span<T>(_lua, _index);
+		};
+	};
+
+	/**
+	 * @brief Span argument which also accepts tables by copying their elements.
+	 *
+	 * Values accepted by std::span are viewed in place as usual, only tables are copied, so binding
+	 * code states explicitly where the copy may happen.
+	 * @code
+	 *	float sum(lua::span_or_copy<const float> _values);
+	 * @endcode
+	*/
+	template <typename T>
+	class span_or_copy
+	{
+	public:
+		static_assert(std::is_const_v<T>, "copied tables are not written back, use span_or_copy<const T>");
+
+		using element_type = T;
+		using value_type = std::remove_cv_t<T>;
+
+		std::span<T> span() const noexcept { return this->span_; };
+		operator std::span<T>() const noexcept { return this->span_; };
+
+		T* data() const noexcept { return this->span_.data(); };
+		size_t size() const noexcept { return this->span_.size(); };
+		auto begin() const noexcept { return this->span_.begin(); };
+		auto end() const noexcept { return this->span_.end(); };
+		T& operator[](size_t _pos) const noexcept { return this->span_[_pos]; };
+
+		/**
+		 * @brief Checks if the elements were copied from a table.
+		*/
+		bool copied() const noexcept { return this->copy_.has_value(); };
+
+		span_or_copy() = default;
+		explicit span_or_copy(std::span<T> _span) noexcept :
+			span_(_span)
+		{};
+		explicit span_or_copy(std::vector<value_type> _copy) :
+			copy_(std::move(_copy))
+		{
+			this->span_ = *this->copy_;
+		};
+
+		span_or_copy(const span_or_copy& other) :
+			copy_(other.copy_), span_(other.span_)
+		{
+			if (this->copy_)
+			{
+				this->span_ = *this->copy_;
+			};
+		};
+		span_or_copy& operator=(const span_or_copy& other)
+		{
+			this->copy_ = other.copy_;
+			this->span_ = (this->copy_) ? std::span<T>(*this->copy_) : other.span_;
+			return *this;
+		};
+
+		// Moving a vector keeps its elements in place so the span stays valid
+		span_or_copy(span_or_copy&& other) noexcept = default;
+		span_or_copy& operator=(span_or_copy&& other) noexcept = default;
+
+	private:
+		std::optional<std::vector<value_type>> copy_{};
+		std::span<T> span_{};
+	};
+
+	/**
+	 * @brief Stack traits type for span_or_copy, tables are copied element by element with try_to.
+	*/
+	template <typename T>
+	struct stack_traits<span_or_copy<T>>
+	{
+		using type = span_or_copy<T>;
+		static void to(state_ptr _lua, int _index, type& _value)
+		{
+			if (auto _result = try_to(_lua, _index); _result)
+			{
+				_value = std::move(*_result);
+			};
+		};
+		static expected<type, conversion_error> try_to(state_ptr _lua, int _index)
+			requires cx_try_pullable<typename type::value_type>
+		{
+			_index = abs(_lua, _index);
+			if (lua_type(_lua, _index) != LUA_TTABLE)
+			{
+				auto _span = impl::try_to_span<T>(_lua, _index);
+				if (!_span)
+				{
+					auto _error = _span.error();
+					_error.expected = "table or viewable array";
+					return unexpected<conversion_error>(_error);
+				};
+				return type(*_span);
+			};
+
+			const auto _count = static_cast<size_t>(lua_rawlen(_lua, _index));
+			auto _copy = std::vector<typename type::value_type>();
+			_copy.reserve(_count);
+			for (size_t n = 0; n != _count; ++n)
+			{
+				lua_rawgeti(_lua, _index, static_cast<lua_Integer>(n) + 1);
+				auto _element = lua::try_to<typename type::value_type>(_lua, -1);
+				pop(_lua);
+				if (!_element)
+				{
+					auto _error = _element.error();
+					_error.index = _index;
+					return unexpected<conversion_error>(_error);
+				};
+				_copy.push_back(std::move(*_element));
+			};
+			return type(std::move(_copy));
+		};
+	};
+
+	namespace impl
+	{
+		template <typename T>
+		struct is_span_or_copy : std::false_type {};
+		template <typename T>
+		struct is_span_or_copy<span_or_copy<T>> : std::true_type {};
+	};
+};
+#pragma endregion
+
+
+
+/*
+	Precompiled string.pack formats
+*/
+
+#pragma region STRUCT_FORMATS
+namespace lua
+{
+	/**
+	 * @brief Opens the "struct" module, use with luaL_requiref.
+	 *
+	 * struct.compile(fmt) parses a string.pack format once and returns a format object with
+	 * pack, unpack, unpack_many (decodes repeated records into typed arrays) and size methods.
+	 *
+	 * @param _lua Lua state.
+	 * @return Number of return values (1, the module table).
+	*/
+	int open_struct(state_ptr _lua);
+};
+#pragma endregion
+
+
+
+/*
+	Struct layouts, arrays of C++ structs accessed field by field from lua
+*/
+
+#pragma region STRUCT_LAYOUTS
+namespace lua
+{
+	/**
+	 * @brief Storage type of a struct layout field.
+	*/
+	enum class field_kind : uint8_t
+	{
+		boolean,
+		int8,
+		uint8,
+		int16,
+		uint16,
+		int32,
+		uint32,
+		int64,
+		uint64,
+		float32,
+		float64,
+
+		// std::string, usertype properties only
+		string,
+	};
+
+	namespace impl
+	{
+		template <typename T>
+		concept cx_layout_field = (std::is_arithmetic_v<T> || std::is_enum_v<T>) && !std::is_same_v<T, long double>;
+
+		template <typename T>
+		requires cx_layout_field<T>
+		constexpr field_kind field_kind_of() noexcept
+		{
+			if constexpr (std::is_enum_v<T>)
+			{
+				return field_kind_of<std::underlying_type_t<T>>();
+			}
+			else if constexpr (std::is_same_v<T, bool>)
+			{
+				return field_kind::boolean;
+			}
+			else if constexpr (std::is_floating_point_v<T>)
+			{
+				static_assert(sizeof(T) == 4 || sizeof(T) == 8);
+				return (sizeof(T) == 4) ? field_kind::float32 : field_kind::float64;
+			}
+			else
+			{
+				static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8);
+				constexpr bool _signed = std::is_signed_v<T>;
+				switch (sizeof(T))
+				{
+				case 1: return (_signed) ? field_kind::int8 : field_kind::uint8;
+				case 2: return (_signed) ? field_kind::int16 : field_kind::uint16;
+				case 4: return (_signed) ? field_kind::int32 : field_kind::uint32;
+				default: return (_signed) ? field_kind::int64 : field_kind::uint64;
+				};
+			};
+		};
+	};
+
+	namespace impl
+	{
+		/**
+		 * @brief Gets the byte offset of a data member.
+		 *
+		 * Member offsets do not depend on the object unless the member belongs to a virtual base,
+		 * which is not supported, so one is measured in raw storage.
+		*/
+		template <typename T, typename M>
+		inline size_t member_offset(M T::* _member) noexcept
+		{
+			alignas(T) static std::byte _storage[sizeof(T)]{};
+			const auto _object = reinterpret_cast<const T*>(_storage);
+			return static_cast<size_t>(reinterpret_cast<const std::byte*>(&(_object->*_member)) - _storage);
+		};
+	};
+
+	/**
+	 * @brief Named data member of a struct, see lua::field.
+	*/
+	template <typename T, typename M>
+	struct struct_field
+	{
+		std::string_view name;
+		M T::* member;
+	};
+
+	/**
+	 * @brief Describes a data member for a struct layout.
+	 * @param _name Name of the field in lua.
+	 * @param _member Member pointer, const members are read-only in lua.
+	*/
+	template <typename T, typename M>
+	requires impl::cx_layout_field<std::remove_cv_t<M>>
+	constexpr auto field(std::string_view _name, M T::* _member) noexcept
+	{
+		return struct_field<T, M>{ _name, _member };
+	};
+
+	/**
+	 * @brief Field names, offsets and types of a standard layout struct.
+	 *
+	 * Arrays of the struct pushed with push_struct_array resolve lua field accesses to an
+	 * offset and type, reading and writing the element in place.
+	 *
+	 * Layouts are referenced by the values pushed to lua, so they must outlive the states they
+	 * are used with, ie. declare them static.
+	*/
+	class struct_layout
+	{
+	public:
+		struct field_info
+		{
+			std::string_view name;
+			size_t offset;
+			field_kind kind;
+			bool readonly;
+		};
+
+		std::string_view name() const noexcept { return this->name_; };
+		size_t size() const noexcept { return this->size_; };
+		std::span<const field_info> fields() const noexcept { return this->fields_; };
+
+		/**
+		 * @brief Checks if this layout was created for a type.
+		*/
+		template <typename T>
+		bool describes() const noexcept
+		{
+			return this->type_ == impl::type_key<std::remove_cv_t<T>>();
+		};
+
+		/**
+		 * @brief Creates the layout of a struct from its fields.
+		 * @param _name Type name shown in lua error messages.
+		 * @param _fields Fields created with lua::field.
+		*/
+		template <typename T, typename... Ms>
+		struct_layout(std::string_view _name, struct_field<T, Ms>... _fields) :
+			name_(_name),
+			size_(sizeof(T)),
+			type_(impl::type_key<T>()),
+			fields_{ field_info{ _fields.name, impl::member_offset(_fields.member), impl::field_kind_of<std::remove_cv_t<Ms>>(), std::is_const_v<Ms> }... }
+		{
+			static_assert(std::is_standard_layout_v<T>, "struct layouts require standard layout types");
+		};
+
+		struct_layout(const struct_layout&) = delete;
+		struct_layout& operator=(const struct_layout&) = delete;
+
+	private:
+		std::string_view name_;
+		size_t size_;
+		const void* type_;
+		std::vector<field_info> fields_;
+	};
+
+	namespace impl
+	{
+		/**
+		 * @brief Pushes an array of structs described by a layout.
+		 * @param _lua Lua state.
+		 * @param _layout Layout of the elements.
+		 * @param _data First element.
+		 * @param _count Number of elements.
+		 * @param _readonly Disallows writes from lua when true.
+		 * @param _lifetime Optional lifetime token of the elements.
+		*/
+		void push_struct_array(state_ptr _lua, const struct_layout& _layout, void* _data, size_t _count,
+			bool _readonly, const view_lifetime* _lifetime);
+	};
+
+	/**
+	 * @brief Pushes a view of an array of structs, indexed as arr[i].field from lua.
+	 *
+	 * Elements are bounds checked and accessed in place, arr[i] yields a small proxy and
+	 * arr:get(i, field) / arr:set(i, field, value) access a field without creating one.
+	 *
+	 * The caller must keep the elements alive for as long as lua can reach the view, use the
+	 * overload taking a view_lifetime when that cannot be guaranteed.
+	 *
+	 * @param _lua Lua state.
+	 * @param _elements Elements to view, spans of const elements produce read-only views.
+	 * @param _layout Layout created for T.
+	*/
+	template <typename T, size_t Extent>
+	inline void push_struct_array(state_ptr _lua, std::span<T, Extent> _elements, const struct_layout& _layout)
+	{
+		assert(_layout.template describes<T>());
+		impl::push_struct_array(_lua, _layout, const_cast<std::remove_cv_t<T>*>(_elements.data()), _elements.size(),
+			std::is_const_v<T>, nullptr);
+	};
+
+	/**
+	 * @brief Pushes a view of an array of structs which raises an error once the lifetime expires.
+	 * @param _lua Lua state.
+	 * @param _elements Elements to view, spans of const elements produce read-only views.
+	 * @param _layout Layout created for T.
+	 * @param _lifetime Lifetime token of the elements.
+	*/
+	template <typename T, size_t Extent>
+	inline void push_struct_array(state_ptr _lua, std::span<T, Extent> _elements, const struct_layout& _layout,
+		const view_lifetime& _lifetime)
+	{
+		assert(_layout.template describes<T>());
+		impl::push_struct_array(_lua, _layout, const_cast<std::remove_cv_t<T>*>(_elements.data()), _elements.size(),
+			std::is_const_v<T>, &_lifetime);
+	};
+};
+#pragma endregion
+
+
+
+/*
+	Usertypes, C++ types stored in userdata with methods and properties
+*/
+
+#pragma region USERTYPES
+namespace lua
+{
+	namespace impl
+	{
+		template <typename M>
+		constexpr field_kind property_kind_of() noexcept
+		{
+			if constexpr (std::is_same_v<M, std::string>)
+			{
+				return field_kind::string;
+			}
+			else
+			{
+				return field_kind_of<M>();
+			};
+		};
+
+		template <typename M>
+		concept cx_property = cx_layout_field<M> || std::is_same_v<M, std::string>;
+
+		void init_usertype_metatable(state_ptr _lua, int _metatableIndex, void* _typeKey, const char* _name, lua_CFunction _gc);
+		void set_usertype_method(state_ptr _lua, int _metatableIndex, const char* _name, lua_CFunction _function);
+		void set_usertype_property(state_ptr _lua, int _metatableIndex, const char* _name, size_t _offset, field_kind _kind, bool _readonly);
+
+		/**
+		 * @brief Raises a type error naming the usertype registered for a type key.
+		*/
+		[[noreturn]] void usertype_type_error(state_ptr _lua, int _arg, void* _typeKey);
+
+		template <typename T>
+		inline int destroy_usertype(state_ptr _lua)
+		{
+			const auto _value = testudata<T>(_lua, 1);
+			if (!_value)
+			{
+				usertype_type_error(_lua, 1, type_key<T>());
+			};
+			std::destroy_at(_value);
+
+			// Like destroy_udata, later uses of the value fail the usertype checks
+			lua_pushnil(_lua);
+			lua_setmetatable(_lua, 1);
+			return 0;
+		};
+
+		/**
+		 * @brief Pushes the usertype metatable of T, creating it if it does not exist yet.
+		 * @return True if the metatable was created by this call.
+		*/
+		template <typename T>
+		inline bool push_usertype_metatable(state_ptr _lua, const char* _name)
+		{
+			return get_or_create_metatable<T>(_lua, [_name](state_ptr _lua, int _metatableIndex)
+			{
+				lua_CFunction _gc = nullptr;
+				if constexpr (!std::is_trivially_destructible_v<T>)
+				{
+					_gc = &destroy_usertype<T>;
+				};
+				init_usertype_metatable(_lua, _metatableIndex, type_key<T>(), _name, _gc);
+			});
+		};
+
+		/**
+		 * @brief Copies the members, casts and metamethods of a registered base usertype into a derived one.
+		 * @param _offset Offset of the base subobject in the derived type.
+		*/
+		void inherit_usertype(state_ptr _lua, int _metatableIndex, void* _baseKey, size_t _offset);
+
+		/**
+		 * @brief Gets the offset of a base class subobject, which must not be a virtual base.
+		*/
+		template <typename T, typename B>
+		inline size_t base_offset() noexcept
+		{
+			alignas(T) static std::byte _storage[sizeof(T)]{};
+			const auto _derived = reinterpret_cast<T*>(_storage);
+			return static_cast<size_t>(reinterpret_cast<std::byte*>(static_cast<B*>(_derived)) - _storage);
+		};
+
+		/*
+			Usertype metatables map the type keys of their own type and of their bases to a cast entry,
+			the offset of that type's subobject shifted left once, the low bit set for base types.
+		*/
+		constexpr inline lua_Integer usertype_base_cast_bit = 1;
+
+		/**
+		 * @brief Gets a usertype value or a value of a type derived from it with a single metatable lookup.
+		 * @return The value, or nullptr if the value at _index is neither.
+		*/
+		template <typename T>
+		inline T* to_usertype(state_ptr _lua, int _index)
+		{
+			if (lua_type(_lua, _index) != LUA_TUSERDATA || !lua_getmetatable(_lua, _index))
+			{
+				return nullptr;
+			};
+
+			const auto _data = static_cast<std::byte*>(lua_touserdata(_lua, _index));
+			if (rawget(_lua, -1, type_key<T>()) == type::number)
+			{
+				const auto _offset = static_cast<size_t>(lua_tointeger(_lua, -1) >> 1);
+				pop(_lua, 2);
+				return reinterpret_cast<T*>(_data + _offset);
+			};
+
+			// Metatables created without lua::usertype only match their exact type
+			rawget(_lua, LUA_REGISTRYINDEX, type_key<T>());
+			const bool _matches = lua_rawequal(_lua, -1, -3) != 0;
+			pop(_lua, 3);
+			return (_matches) ? reinterpret_cast<T*>(_data) : nullptr;
+		};
+	};
+
+	/**
+	 * @brief Registers methods and properties of a C++ type stored by value in userdata.
+	 *
+	 * Properties are data members read and written in place : each is stored in the usertype's member
+	 * table as its byte offset and field kind, and a single __index / __newindex pair reads them with one
+	 * code path per field kind, so bound fields cost no generated code.
+	 *
+	 * The metatable is the one of get_or_create_metatable<T>, registering again extends it.
+	 * @code
+	 *	lua::usertype<vec2>(_lua, "vec2")
+	 *		.property("x", &vec2::x)
+	 *		.property("y", &vec2::y)
+	 *		.method("length", &vec2_length);
+	 * @endcode
+	*/
+	template <typename T>
+	class usertype
+	{
+	public:
+		/**
+		 * @brief Adds a method, methods are looked up after properties.
+		*/
+		usertype& method(const char* _name, lua_CFunction _function)
+		{
+			impl::set_usertype_method(this->lua_, this->metatable_, _name, _function);
+			return *this;
+		};
+
+		/**
+		 * @brief Sets a metamethod, ie. "__tostring", "__eq" or "__call".
+		*/
+		usertype& metamethod(const char* _name, lua_CFunction _function)
+		{
+			lua_pushcfunction(this->lua_, _function);
+			lua_setfield(this->lua_, this->metatable_, _name);
+			return *this;
+		};
+
+		/**
+		 * @brief Adds a property for a data member, const members are read-only.
+		*/
+		template <typename M>
+		requires impl::cx_property<std::remove_cv_t<M>>
+		usertype& property(const char* _name, M T::* _member)
+		{
+			impl::set_usertype_property(this->lua_, this->metatable_, _name, impl::member_offset(_member),
+				impl::property_kind_of<std::remove_cv_t<M>>(), std::is_const_v<M>);
+			return *this;
+		};
+
+		/**
+		 * @brief Adds a property for a data member which cannot be assigned from lua.
+		*/
+		template <typename M>
+		requires impl::cx_property<std::remove_cv_t<M>>
+		usertype& readonly_property(const char* _name, M T::* _member)
+		{
+			impl::set_usertype_property(this->lua_, this->metatable_, _name, impl::member_offset(_member),
+				impl::property_kind_of<std::remove_cv_t<M>>(), true);
+			return *this;
+		};
+
+		/**
+		 * @brief Declares a base class, whose usertype must already be registered.
+		 *
+		 * The base's methods, properties and metamethods are copied into this usertype so lookups never
+		 * walk a chain of metatables, members already set here take precedence. Values of this type are
+		 * then accepted wherever the base is, see check_usertype. Members added to the base afterwards
+		 * are not inherited.
+		*/
+		template <typename B>
+		usertype& base()
+		{
+			static_assert(std::is_base_of_v<B, T> && !std::is_same_v<B, T>, "B must be a base class of T");
+			impl::inherit_usertype(this->lua_, this->metatable_, impl::type_key<B>(), impl::base_offset<T, B>());
+			return *this;
+		};
+
+		/**
+		 * @brief Gets the stack index of the usertype's metatable.
+		*/
+		int metatable() const noexcept { return this->metatable_; };
+
+		/**
+		 * @brief Pushes the usertype's metatable, leaving it on the stack while the usertype is alive.
+		 * @param _name Type name, used as __name and in error messages.
+		*/
+		usertype(state_ptr _lua, const char* _name) :
+			lua_(_lua)
+		{
+			// The metatable may have been created by emplace_userdata under the C++ type name
+			if (!impl::push_usertype_metatable<T>(_lua, _name))
+			{
+				lua_pushstring(_lua, _name);
+				lua_setfield(_lua, -2, "__name");
+			};
+			this->metatable_ = top(_lua);
+		};
+
+		usertype(const usertype&) = delete;
+		usertype& operator=(const usertype&) = delete;
+
+		~usertype()
+		{
+			lua_remove(this->lua_, this->metatable_);
+		};
+
+	private:
+		state_ptr lua_;
+		int metatable_;
+	};
+
+	/**
+	 * @brief Pushes a new userdata with a T constructed in place from the given arguments.
+	 *
+	 * The userdata gets the usertype metatable of T, found with a single registry lookup once the
+	 * usertype exists. Unregistered types get a usertype metatable named after the C++ type so that
+	 * they are still destroyed when collected, a later lua::usertype registration extends it.
+	 *
+	 * @tparam T Type to construct.
+	 * @tparam NUserValues Number of user values of the userdata, see lua_getiuservalue.
+	 * @return The constructed value, the userdata is left on top of the stack.
+	*/
+	template <typename T, int NUserValues = 0, typename... ArgTs>
+	inline T& emplace_userdata(state_ptr _lua, ArgTs&&... _args)
+	{
+		static_assert(alignof(T) <= alignof(std::max_align_t), "userdata memory is not aligned for T");
+		static_assert(std::is_constructible_v<T, ArgTs...>, "T is not constructible from the given arguments");
+
+		const auto _memory = newuserdata(_lua, sizeof(T), NUserValues);
+		T* _value = nullptr;
+		try
+		{
+			_value = std::construct_at(static_cast<T*>(_memory), std::forward<ArgTs>(_args)...);
+		}
+		catch (...)
+		{
+			pop(_lua);
+			throw;
+		};
+
+		// Set after construction so that __gc never sees an unconstructed value
+		if (rawget(_lua, LUA_REGISTRYINDEX, impl::type_key<T>()) != type::table)
+		{
+			pop(_lua);
+			impl::push_usertype_metatable<T>(_lua, std::string(userdata_type_name<T>()).c_str());
+		};
+		setmetatable(_lua, -2);
+		return *_value;
+	};
+
+	/**
+	 * @brief Gets a usertype value, raising a type error if the value at _index is not one.
+	 *
+	 * Values of usertypes derived from T are accepted and adjusted to their T subobject.
+	*/
+	template <typename T>
+	inline T& check_usertype(state_ptr _lua, int _index)
+	{
+		const auto _value = impl::to_usertype<T>(_lua, _index);
+		if (!_value)
+		{
+			impl::usertype_type_error(_lua, _index, impl::type_key<T>());
+		};
+		return *_value;
+	};
+};
+#pragma endregion
+
+
+
+/*
+	Binding C++ functions and overload sets
+*/
+
+#pragma region FUNCTION_BINDING
+namespace lua
+{
+	namespace impl
+	{
+		/**
+		 * @brief Lua value categories overloads are resolved on, numbers are split into integers and floats.
+		*/
+		enum class arg_class : uint8_t
+		{
+			nil,
+			boolean,
+			integer,
+			number,
+			string,
+			table,
+			function,
+			userdata,
+			lightuserdata,
+			thread,
+		};
+		constexpr inline size_t arg_class_count = 10;
+
+		constexpr uint32_t arg_class_bit(arg_class _class) noexcept
+		{
+			return uint32_t(1) << static_cast<size_t>(_class);
+		};
+
+		inline arg_class arg_class_of(state_ptr _lua, int _index) noexcept
+		{
+			switch (lua_type(_lua, _index))
+			{
+			case LUA_TBOOLEAN: return arg_class::boolean;
+			case LUA_TNUMBER: return (lua_isinteger(_lua, _index)) ? arg_class::integer : arg_class::number;
+			case LUA_TSTRING: return arg_class::string;
+			case LUA_TTABLE: return arg_class::table;
+			case LUA_TFUNCTION: return arg_class::function;
+			case LUA_TUSERDATA: return arg_class::userdata;
+			case LUA_TLIGHTUSERDATA: return arg_class::lightuserdata;
+			case LUA_TTHREAD: return arg_class::thread;
+			default: return arg_class::nil;
+			};
+		};
+
+		/**
+		 * @brief Usertype accepted by a parameter, U for U, U&, U* and their const forms.
+		*/
+		template <typename P>
+		using usertype_param_t = std::remove_cv_t<std::remove_pointer_t<std::remove_cvref_t<P>>>;
+
+		template <typename P>
+		concept cx_usertype_param = !cx_pullable<std::remove_cvref_t<P>> && std::is_class_v<usertype_param_t<P>> &&
+			(!std::is_pointer_v<std::remove_cvref_t<P>> || !std::is_pointer_v<std::remove_pointer_t<std::remove_cvref_t<P>>>);
+
+		struct param_info
+		{
+			arg_class type;
+
+			// Usertype key for usertype parameters, see type_key
+			const void* usertype = nullptr;
+
+			// Bitmask of argument classes taken with a conversion, ie. integers for floats and named enums
+			uint32_t converts = 0;
+
+			// Optional parameters also take nil, trailing ones may be omitted
+			bool optional = false;
+
+			// Bitmask of other argument classes taken as is
+			uint32_t also = 0;
+
+			// Tests userdata for userdata parameters without a usertype key, ie. spans
+			bool(*accepts)(state_ptr, int) = nullptr;
+		};
+
+
+		template <typename P>
+		constexpr param_info param_info_of() noexcept
+		{
+			using value_type = std::remove_cvref_t<P>;
+			if constexpr (is_std_optional<value_type>::value)
+			{
+				auto _info = param_info_of<typename value_type::value_type>();
+				_info.optional = true;
+				return _info;
+			}
+			else if constexpr (is_std_variant<value_type>::value)
+			{
+				// The classes of the slots the variant dispatches on, see make_variant_dispatch
+				return []<typename... Ts>(std::type_identity<std::variant<Ts...>>)
+				{
+					constexpr auto _classOf = [](size_t _slot)
+					{
+						switch (_slot)
+						{
+						case LUA_TNIL: return arg_class::nil;
+						case LUA_TBOOLEAN: return arg_class::boolean;
+						case LUA_TLIGHTUSERDATA: return arg_class::lightuserdata;
+						case LUA_TNUMBER: return arg_class::number;
+						case LUA_TSTRING: return arg_class::string;
+						case LUA_TTABLE: return arg_class::table;
+						case LUA_TFUNCTION: return arg_class::function;
+						case LUA_TUSERDATA: return arg_class::userdata;
+						case LUA_TTHREAD: return arg_class::thread;
+						default: return arg_class::integer;
+						};
+					};
+
+					uint32_t _exact = 0;
+					uint32_t _converted = 0;
+					for (const auto& _slots : { variant_slots_of<Ts>()... })
+					{
+						for (size_t _slot = 0; _slot != variant_slot_count; ++_slot)
+						{
+							const auto _bit = uint32_t(1) << _slot;
+							_exact |= (_slots.exact & _bit) ? arg_class_bit(_classOf(_slot)) : 0;
+							_converted |= (_slots.converted & _bit) ? arg_class_bit(_classOf(_slot)) : 0;
+						};
+					};
+
+					// Alternatives taking nil make the parameter optional
+					auto _info = param_info{ arg_class::nil };
+					_info.optional = (_exact & arg_class_bit(arg_class::nil)) != 0;
+					const auto _taken = _exact & ~arg_class_bit(arg_class::nil);
+					if (_taken != 0)
+					{
+						_info.type = arg_class(std::countr_zero(_taken));
+					};
+					_info.also = _taken & ~arg_class_bit(_info.type);
+					_info.converts = _converted & ~_exact;
+					return _info;
+				}(std::type_identity<value_type>{});
+			}
+			else if constexpr (cx_usertype_param<P>)
+			{
+				return param_info{ arg_class::userdata, &type_key_storage<usertype_param_t<P>>::value };
+			}
+			else if constexpr (std::is_same_v<value_type, bool>)
+			{
+				return param_info{ arg_class::boolean };
+			}
+			else if constexpr (cx_named_enum<value_type>)
+			{
+				return param_info{ arg_class::string, nullptr, arg_class_bit(arg_class::integer) };
+			}
+			else if constexpr (std::is_integral_v<value_type> || std::is_enum_v<value_type>)
+			{
+				// Floats are converted like luaL_checkinteger, failing if they have no integer value
+				return param_info{ arg_class::integer, nullptr, arg_class_bit(arg_class::number) };
+			}
+			else if constexpr (std::is_floating_point_v<value_type>)
+			{
+				return param_info{ arg_class::number, nullptr, arg_class_bit(arg_class::integer) };
+			}
+			else if constexpr (is_span<value_type>::value || is_span_or_copy<value_type>::value)
+			{
+				// Spans view userdata, and strings for bytes, span_or_copy also copies tables
+				using element_type = typename value_type::element_type;
+				uint32_t _also = 0;
+				if constexpr (std::is_const_v<element_type> && cx_byte_like<element_type>)
+				{
+					_also |= uint32_t(1) << static_cast<size_t>(arg_class::string);
+				};
+				if constexpr (is_span_or_copy<value_type>::value)
+				{
+					_also |= uint32_t(1) << static_cast<size_t>(arg_class::table);
+				};
+				return param_info{ arg_class::userdata, nullptr, 0, false, _also, &is_span_source<element_type> };
+			}
+			else if constexpr (is_chrono_duration<value_type>::value || is_chrono_time_point<value_type>::value)
+			{
+				const bool _float = stack_traits<value_type>::default_encoding == time_encoding::float_seconds;
+				return (_float) ?
+					param_info{ arg_class::number, nullptr, arg_class_bit(arg_class::integer) } :
+					param_info{ arg_class::integer, nullptr, arg_class_bit(arg_class::number) };
+			}
+			else if constexpr (std::is_same_v<value_type, lua_CFunction>)
+			{
+				return param_info{ arg_class::function };
+			}
+			else
+			{
+				static_assert(std::is_constructible_v<std::string_view, value_type>,
+					"parameter type has no lua argument class, bind it with a lua_CFunction instead");
+				return param_info{ arg_class::string };
+			};
+		};
+
+		/**
+		 * @brief Scores an argument against a parameter : 2 exact, 1 converted (ie. between integers and floats), 0 rejected.
+		*/
+		constexpr int match_score(const param_info& _param, arg_class _arg) noexcept
+		{
+			if (_param.type == _arg || (_param.optional && _arg == arg_class::nil) || (_param.also & arg_class_bit(_arg)))
+			{
+				return 2;
+			};
+			return (_param.converts & arg_class_bit(_arg)) ? 1 : 0;
+		};
+
+		template <typename F>
+		struct bound_function;
+
+		template <typename R, typename... Args>
+		struct bound_function<R(*)(Args...)>
+		{
+			using result_type = R;
+			using params = std::tuple<Args...>;
+		};
+		template <typename R, typename... Args>
+		struct bound_function<R(*)(Args...) noexcept> : bound_function<R(*)(Args...)> {};
+
+		// Member functions take the object as their first parameter
+		template <typename R, typename C, typename... Args>
+		struct bound_function<R(C::*)(Args...)>
+		{
+			using result_type = R;
+			using params = std::tuple<C&, Args...>;
+		};
+		template <typename R, typename C, typename... Args>
+		struct bound_function<R(C::*)(Args...) const>
+		{
+			using result_type = R;
+			using params = std::tuple<const C&, Args...>;
+		};
+		template <typename R, typename C, typename... Args>
+		struct bound_function<R(C::*)(Args...) noexcept> : bound_function<R(C::*)(Args...)> {};
+		template <typename R, typename C, typename... Args>
+		struct bound_function<R(C::*)(Args...) const noexcept> : bound_function<R(C::*)(Args...) const> {};
+
+		template <auto F>
+		constexpr inline size_t arity_v = std::tuple_size_v<typename bound_function<decltype(F)>::params>;
+
+		/**
+		 * @brief Holds a converted argument until the bound function is called.
+		*/
+		template <typename P>
+		struct arg_holder
+		{
+			std::remove_cvref_t<P> value{};
+
+			/**
+			 * @return The conversion error, if any.
+			*/
+			std::optional<conversion_error> get_from(state_ptr _lua, int _index)
+			{
+				if constexpr (cx_try_pullable<std::remove_cvref_t<P>>)
+				{
+					auto _value = try_to<std::remove_cvref_t<P>>(_lua, _index);
+					if (!_value)
+					{
+						return _value.error();
+					};
+					this->value = std::move(*_value);
+				}
+				else
+				{
+					to(_lua, _index, this->value);
+				};
+				return std::nullopt;
+			};
+			decltype(auto) get() noexcept
+			{
+				return static_cast<P>(this->value);
+			};
+		};
+
+		template <typename P>
+		requires cx_usertype_param<P>
+		struct arg_holder<P>
+		{
+			usertype_param_t<P>* value = nullptr;
+
+			std::optional<conversion_error> get_from(state_ptr _lua, int _index)
+			{
+				this->value = to_usertype<usertype_param_t<P>>(_lua, _index);
+				return std::nullopt;
+			};
+			decltype(auto) get() noexcept
+			{
+				if constexpr (std::is_pointer_v<std::remove_cvref_t<P>>)
+				{
+					return this->value;
+				}
+				else
+				{
+					return static_cast<P>(*this->value);
+				};
+			};
+		};
+
+		/**
+		 * @brief Pushes the value returned by a bound function.
+		 * @return Number of values pushed.
+		*/
+		template <typename R>
+		inline int push_bound_result(state_ptr _lua, R&& _result)
+		{
+			if constexpr (!cx_pushable<R> && std::is_class_v<std::remove_cvref_t<R>>)
+			{
+				// Values of usertypes are moved into a new userdata
+				emplace_userdata<std::remove_cvref_t<R>>(_lua, std::forward<R>(_result));
+				return 1;
+			}
+			else
+			{
+				const auto _top = top(_lua);
+				push(_lua, std::forward<R>(_result));
+				return top(_lua) - _top;
+			};
+		};
+
+		/**
+		 * @brief Calls a bound function with the arguments on the stack, their classes must have been checked.
+		 *
+		 * Arguments failing their checked conversion, such as out of range integers, are reported together
+		 * by a single error raised after the converted arguments are destroyed.
+		*/
+		template <auto F>
+		inline int invoke_bound(state_ptr _lua)
+		{
+			using traits = bound_function<decltype(F)>;
+			std::array<conversion_error, std::tuple_size_v<typename traits::params>> _errors{};
+			size_t _errorCount = 0;
+
+			const auto _results = [_lua, &_errors, &_errorCount]<size_t... Is>(std::index_sequence<Is...>) -> int
+			{
+				std::tuple<arg_holder<std::tuple_element_t<Is, typename traits::params>>...> _args{};
+				const auto _collect = [&_errors, &_errorCount](std::optional<conversion_error> _error)
+				{
+					if (_error)
+					{
+						_errors[_errorCount++] = *_error;
+					};
+				};
+				(_collect(std::get<Is>(_args).get_from(_lua, static_cast<int>(Is) + 1)), ...);
+				if (_errorCount != 0)
+				{
+					return 0;
+				};
+
+				if constexpr (std::is_void_v<typename traits::result_type>)
+				{
+					std::invoke(F, std::get<Is>(_args).get()...);
+					return 0;
+				}
+				else
+				{
+					return push_bound_result(_lua, std::invoke(F, std::get<Is>(_args).get()...));
+				};
+			}(std::make_index_sequence<std::tuple_size_v<typename traits::params>>{});
+
+			if (_errorCount != 0)
+			{
+				raise_argument_errors(_lua, _errors.data(), _errorCount);
+			};
+			return _results;
+		};
+
+		template <auto F>
+		constexpr auto param_infos() noexcept
+		{
+			using params = typename bound_function<decltype(F)>::params;
+			return []<size_t... Is>(std::index_sequence<Is...>)
+			{
+				return std::array<param_info, sizeof...(Is)>{ param_info_of<std::tuple_element_t<Is, params>>()... };
+			}(std::make_index_sequence<std::tuple_size_v<params>>{});
+		};
+
+		/**
+		 * @brief Compile time resolution tables of an overload set.
+		 *
+		 * exact[k][c] and converted[k][c] hold bitmasks of the overloads accepting an argument of class c at
+		 * position k, exactly or with a conversion. Resolution narrows the overloads of matching arity
+		 * position by position, preferring exact matches, so it is a walk of a decision tree encoded in masks.
+		*/
+		template <size_t Count, size_t MaxArity>
+		struct overload_table
+		{
+			std::array<size_t, Count> arity{};
+
+			// Arity without the trailing optional parameters
+			std::array<size_t, Count> min_arity{};
+			std::array<std::array<param_info, (MaxArity == 0) ? 1 : MaxArity>, Count> params{};
+			std::array<std::array<uint32_t, arg_class_count>, (MaxArity == 0) ? 1 : MaxArity> exact{};
+			std::array<std::array<uint32_t, arg_class_count>, (MaxArity == 0) ? 1 : MaxArity> converted{};
+			bool usertypes = false;
+
+			/**
+			 * @brief Checks if two overloads can both remain after resolution for some arguments.
+			*/
+			constexpr bool ambiguous(size_t _a, size_t _b) const noexcept
+			{
+				const auto _lowest = std::max(this->min_arity[_a], this->min_arity[_b]);
+				const auto _highest = std::min(this->arity[_a], this->arity[_b]);
+				for (size_t _count = _lowest; _count <= _highest; ++_count)
+				{
+					if (this->ambiguous(_a, _b, _count))
+					{
+						return true;
+					};
+				};
+				return false;
+			};
+
+			// Checks for _count arguments, both overloads accepting that many
+			constexpr bool ambiguous(size_t _a, size_t _b, size_t _count) const noexcept
+			{
+				for (size_t k = 0; k != _count; ++k)
+				{
+					const auto& _pa = this->params[_a][k];
+					const auto& _pb = this->params[_b][k];
+					if (_pa.usertype != _pb.usertype)
+					{
+						return false;
+					};
+					bool _overlap = false;
+					for (size_t c = 0; c != arg_class_count; ++c)
+					{
+						const auto _score = match_score(_pa, arg_class(c));
+						_overlap = _overlap || (_score != 0 && _score == match_score(_pb, arg_class(c)));
+					};
+					if (!_overlap)
+					{
+						return false;
+					};
+				};
+				return true;
+			};
+
+			constexpr bool ambiguous() const noexcept
+			{
+				for (size_t a = 0; a != Count; ++a)
+				{
+					for (size_t b = a + 1; b != Count; ++b)
+					{
+						if (this->ambiguous(a, b))
+						{
+							return true;
+						};
+					};
+				};
+				return false;
+			};
+		};
+
+		template <auto... Fs>
+		constexpr auto make_overload_table() noexcept
+		{
+			constexpr size_t _maxArity = std::max({ size_t(0), arity_v<Fs>... });
+			auto _table = overload_table<sizeof...(Fs), _maxArity>{};
+			size_t _index = 0;
+			([&]()
+			{
+				constexpr auto _infos = param_infos<Fs>();
+				_table.arity[_index] = _infos.size();
+				_table.min_arity[_index] = _infos.size();
+				while (_table.min_arity[_index] != 0 && _infos[_table.min_arity[_index] - 1].optional)
+				{
+					--_table.min_arity[_index];
+				};
+				for (size_t k = 0; k != _infos.size(); ++k)
+				{
+					_table.params[_index][k] = _infos[k];
+					_table.usertypes = _table.usertypes || _infos[k].usertype != nullptr;
+					for (size_t c = 0; c != arg_class_count; ++c)
+					{
+						const auto _score = match_score(_infos[k], arg_class(c));
+						if (_score == 2)
+						{
+							_table.exact[k][c] |= uint32_t(1) << _index;
+						}
+						else if (_score == 1)
+						{
+							_table.converted[k][c] |= uint32_t(1) << _index;
+						};
+					};
+				};
+				++_index;
+			}(), ...);
+			return _table;
+		};
+
+		/**
+		 * @brief Removes the overloads whose usertype parameter at _index does not match the argument.
+		 *
+		 * Overloads taking the argument's exact type are preferred over those taking one of its bases. Span
+		 * parameters keep only the userdata they can view, see is_span_source.
+		*/
+		uint32_t filter_usertype_overloads(state_ptr _lua, int _index, uint32_t _mask, const param_info* _params, size_t _stride);
+
+		/**
+		 * @brief Raises the error for arguments no overload accepts.
+		*/
+		[[noreturn]] void no_matching_overload(state_ptr _lua);
+
+		template <auto... Fs, size_t... Is>
+		inline int invoke_overload(state_ptr _lua, size_t _overload, std::index_sequence<Is...>)
+		{
+			int _results = 0;
+			((Is == _overload && ((_results = invoke_bound<Fs>(_lua)), true)) || ...);
+			return _results;
+		};
+	};
+
+	/**
+	 * @brief Lua C function calling a C++ function or the best match of an overload set.
+	 *
+	 * Arguments are converted with stack_traits, class types without stack traits are usertypes and
+	 * member functions take their object as the first argument. The overload is selected by the
+	 * number of arguments and then by the type of each argument, integers preferring integral
+	 * parameters and floats floating point ones. std::optional parameters also take nil, and trailing
+	 * ones may be omitted. Overloads which could both be selected for the same arguments are a
+	 * compile error.
+	 * @code
+	 *	lua::push(_lua, &lua::bind<&dot2, &dot3>);
+	 *	lua_setglobal(_lua, "dot");
+	 *	lua::usertype<vec2>(_lua, "vec2").method("scale", &lua::bind<&vec2::scale>);
+	 * @endcode
+	*/
+	template <auto... Fs>
+	inline int bind(state_ptr _lua)
+	{
+		static_assert(sizeof...(Fs) != 0 && sizeof...(Fs) <= 32, "bind takes between 1 and 32 functions");
+		static constexpr auto _table = impl::make_overload_table<Fs...>();
+		static_assert(!_table.ambiguous(), "ambiguous overload set, some arguments match several functions equally");
+
+		const auto _count = static_cast<size_t>(top(_lua));
+		uint32_t _mask = 0;
+		for (size_t n = 0; n != sizeof...(Fs); ++n)
+		{
+			_mask |= (_count >= _table.min_arity[n] && _count <= _table.arity[n]) ? (uint32_t(1) << n) : 0;
+		};
+
+		for (size_t k = 0; k != _count && _mask != 0; ++k)
+		{
+			const auto _class = static_cast<size_t>(impl::arg_class_of(_lua, static_cast<int>(k) + 1));
+			const auto _exact = _mask & _table.exact[k][_class];
+			_mask = (_exact != 0) ? _exact : (_mask & _table.converted[k][_class]);
+			if constexpr (_table.usertypes)
+			{
+				if (_class == static_cast<size_t>(impl::arg_class::userdata))
+				{
+					_mask = impl::filter_usertype_overloads(_lua, static_cast<int>(k) + 1, _mask, &_table.params[0][k], _table.params[0].size());
+				};
+			};
+		};
+		if (_mask == 0)
+		{
+			impl::no_matching_overload(_lua);
+		};
+		return impl::invoke_overload<Fs...>(_lua, static_cast<size_t>(std::countr_zero(_mask)), std::make_index_sequence<sizeof...(Fs)>{});
+	};
+};
+#pragma endregion
+
+
+
+/*
+	Table utilities
+*/
+
+#pragma region TABLE_UTILITIES
+namespace lua
+{
+	/**
+	 * @brief Removes every entry of a table while keeping its allocated capacity.
+	 * @param _lua Lua state.
+	 * @param _index Index of the table.
+	*/
+	void cleartable(state_ptr _lua, int _index);
+
+	/**
+	 * @brief Live entries and allocated slots of a table.
+	*/
+	struct table_usage
+	{
+		size_t array_count = 0;		// live entries in (or belonging to) the array part
+		size_t hash_count = 0;		// live entries in the hash part
+		size_t array_size = 0;		// allocated array slots, 0 unless sizes_known
+		size_t hash_size = 0;		// allocated hash slots, 0 unless sizes_known
+		size_t slack_bytes = 0;		// bytes held by unused slots, 0 unless sizes_known
+
+		// Allocated sizes are only available when built against the lua internals (LUA_CPP_LUA_INTERNALS)
+		bool sizes_known = false;
+	};
+
+	/**
+	 * @brief Counts the live entries of a table and, when available, its allocated slots.
+	 * @param _lua Lua state.
+	 * @param _index Index of the table.
+	*/
+	table_usage get_table_usage(state_ptr _lua, int _index);
+
+	/**
+	 * @brief Shrinks a table to fit its live entries, keeping its identity.
+	 *
+	 * Built against the lua internals the table is resized in place to exactly the size a rehash
+	 * would pick. Otherwise the entries are moved out and reinserted, which lets lua's next
+	 * rehash reclaim the unused slots but does not guarantee it.
+	 *
+	 * @param _lua Lua state.
+	 * @param _index Index of the table.
+	 * @return True if the table was resized exactly.
+	*/
+	bool compact(state_ptr _lua, int _index);
+
+	/**
+	 * @brief Layout problems found by analyze_table_shapes, combined as flags.
+	*/
+	enum class table_shape_issue : uint8_t
+	{
+		none = 0,
+		integer_keys_in_hash = 1 << 0,	// dense integer keys stored as hash nodes, needs internals to detect
+		sparse_array = 1 << 1,			// integer keys spread over a much larger range
+		oversized_hash = 1 << 2,		// hash part mostly empty, needs internals to detect
+		oversized_array = 1 << 3,		// array part mostly empty, needs internals to detect
+		mixed_array = 1 << 4,			// array values of more than one type
+	};
+
+	constexpr table_shape_issue operator|(table_shape_issue _lhs, table_shape_issue _rhs) noexcept
+	{
+		return table_shape_issue(static_cast<uint8_t>(_lhs) | static_cast<uint8_t>(_rhs));
+	};
+	constexpr table_shape_issue operator&(table_shape_issue _lhs, table_shape_issue _rhs) noexcept
+	{
+		return table_shape_issue(static_cast<uint8_t>(_lhs) & static_cast<uint8_t>(_rhs));
+	};
+
+	/**
+	 * @brief Shape of a table with layout problems.
+	*/
+	struct table_shape
+	{
+		std::string path;				// first path the table was found at, ie. "_G.cache.items"
+		const void* table = nullptr;	// identity, as returned by lua_topointer
+		table_usage usage{};
+		size_t integer_keys = 0;		// positive integer keys
+		size_t integer_keys_in_hash = 0;
+		lua_Integer max_integer_key = 0;
+		table_shape_issue issues = table_shape_issue::none;
+		size_t estimated_waste = 0;		// bytes, exact slack plus estimated node overhead
+	};
+
+	struct table_shape_options
+	{
+		// Tables with fewer entries are not reported
+		size_t min_entries = 16;
+	};
+
+	/**
+	 * @brief Walks every table reachable from the globals and the registry and reports layout problems.
+	 *
+	 * Tables are reached through table keys and values, metatables, function upvalues and userdata
+	 * user values, without invoking metamethods.
+	 *
+	 * @param _lua Lua state.
+	 * @param _options Reporting thresholds.
+	 * @return Tables with issues, by decreasing estimated waste.
+	*/
+	std::vector<table_shape> analyze_table_shapes(state_ptr _lua, const table_shape_options& _options = {});
+
+	/**
+	 * @brief Opens the "tablex" module, use with luaL_requiref.
+	 *
+	 * tablex.new(narr, nrec) creates a presized table, tablex.clear(t) empties a table in place,
+	 * tablex.acquire / tablex.release reuse temporary tables through a per-state pool and
+	 * tablex.compact(t) / tablex.usage(t) reclaim and report the slack of long-lived tables and
+	 * tablex.analyze([min_entries]) reports misshapen tables, see analyze_table_shapes.
+	 *
+	 * @param _lua Lua state.
+	 * @return Number of return values (1, the module table).
+	*/
+	int open_tablex(state_ptr _lua);
+};
+#pragma endregion
+
+
+
+/*
+	Heap census, snapshots of the object graph for leak hunting
+*/
+
+#pragma region HEAP_CENSUS
+namespace lua
+{
+	namespace impl
+	{
+		struct heap_builder;
+	};
+
+	/**
+	 * @brief Graph of the objects reachable in a lua state, with dominator based retained sizes.
+	 *
+	 * Objects are reached from the globals, the registry, the stack and locals of the calling
+	 * thread and the stacks of reachable coroutines, through table entries, metatables, upvalues
+	 * and user values. Lua does not expose object sizes, self sizes are estimates.
+	*/
+	class heap_snapshot
+	{
+	public:
+		enum class edge_kind : uint8_t
+		{
+			context,	// upvalues and locals
+			element,	// integer keys, name is the index
+			property,	// string keys
+			internal,	// metatables, user values, keys
+			weak,		// entries of weak tables, ignored for retained sizes
+		};
+
+		struct node
+		{
+			const void* address = nullptr;
+			int type = LUA_TNONE;		// lua type, LUA_TNONE for the root
+			uint32_t name = 0;			// index into strings()
+			uint32_t class_name = 0;	// index into strings(), ie. the __name of a table
+			size_t self_size = 0;
+			size_t retained_size = 0;
+			uint32_t dominator = 0;		// immediate dominator, the root dominates itself
+			uint32_t parent_edge = 0;	// edge this node was first reached through
+			uint32_t first_edge = 0;
+			uint32_t edge_count = 0;
+		};
+
+		struct edge
+		{
+			edge_kind kind;
+			uint32_t name;		// index into strings(), the index itself for element edges
+			uint32_t from;
+			uint32_t to;
+		};
+
+		struct class_stats
+		{
+			std::string_view name;
+			size_t count = 0;
+			size_t self_size = 0;
+		};
+
+		/**
+		 * @brief Nodes of the graph, node 0 is the synthetic root.
+		*/
+		std::span<const node> nodes() const noexcept { return this->nodes_; };
+		std::span<const edge> edges() const noexcept { return this->edges_; };
+		std::span<const std::string> strings() const noexcept { return this->strings_; };
+
+		std::span<const edge> edges_of(const node& _node) const noexcept
+		{
+			return std::span<const edge>(this->edges_).subspan(_node.first_edge, _node.edge_count);
+		};
+
+		/**
+		 * @brief Estimated size of every reachable object.
+		*/
+		size_t total_size() const noexcept
+		{
+			return (this->nodes_.empty()) ? 0 : this->nodes_.front().retained_size;
+		};
+
+		/**
+		 * @brief Object counts and sizes grouped by class name, by decreasing size.
+		*/
+		std::vector<class_stats> census() const;
+
+		/**
+		 * @brief Path a node was first reached through, ie. "globals.cache.items[3]".
+		*/
+		std::string path_to(uint32_t _node) const;
+
+		/**
+		 * @brief Formats the census and the largest retainers as text.
+		 * @param _count Number of rows of each section.
+		*/
+		std::string report(size_t _count = 20) const;
+
+		/**
+		 * @brief Writes the snapshot in the .heapsnapshot format read by Chromium's developer tools.
+		 * @return True on success, false and errno set otherwise.
+		*/
+		bool write(const char* _path) const;
+
+	private:
+		friend impl::heap_builder;
+
+		std::vector<node> nodes_;
+		std::vector<edge> edges_;
+		std::vector<std::string> strings_;
+	};
+
+	/**
+	 * @brief Walks the heap of a lua state.
+	 * @param _lua Lua state, the values on its stack are roots of the snapshot.
+	 * @param _outSnapshot Snapshot to fill.
+	 * @return True on success, false when lua ran out of memory during the walk.
+	*/
+	bool take_heap_snapshot(state_ptr _lua, heap_snapshot& _outSnapshot);
+
+	/**
+	 * @brief Change of a class between two snapshots.
+	*/
+	struct heap_diff_entry
+	{
+		std::string name;
+		ptrdiff_t count = 0;
+		ptrdiff_t self_size = 0;
+	};
+
+	/**
+	 * @brief Compares the census of two snapshots.
+	 * @return Classes whose count or size changed, by decreasing size change.
+	*/
+	std::vector<heap_diff_entry> diff_heap_snapshots(const heap_snapshot& _before, const heap_snapshot& _after);
+
+	/**
+	 * @brief Opens the "heap" module, use with luaL_requiref.
+	 *
+	 * heap.snapshot() returns a snapshot with report([n]), write(path) and size() methods,
+	 * heap.diff(before, after [, n]) formats the changes between two snapshots.
+	 *
+	 * @param _lua Lua state.
+	 * @return Number of return values (1, the module table).
+	*/
+	int open_heap(state_ptr _lua);
+};
+#pragma endregion
+
+
+
+/*
+	Garbage collector telemetry
+*/
+
+#pragma region GC_TELEMETRY
+namespace lua
+{
+	/**
+	 * @brief Log-linear histogram of unsigned values with a fixed relative precision, HDR histogram style.
+	 *
+	 * Values are counted in buckets of 1/32 to 1/16 of their power of two, recording never allocates.
+	*/
+	class hdr_histogram
+	{
+	public:
+		static constexpr size_t sub_bucket_bits = 5;
+		static constexpr size_t sub_bucket_count = size_t(1) << sub_bucket_bits;
+		static constexpr size_t sub_bucket_half = sub_bucket_count / 2;
+		static constexpr size_t bucket_count = 64 - sub_bucket_bits + 1;
+		static constexpr size_t counts_size = (bucket_count + 1) * sub_bucket_half;
+
+		void record(uint64_t _value) noexcept
+		{
+			++this->counts_[index_of(_value)];
+			++this->total_;
+			this->sum_ += _value;
+			this->min_ = std::min(this->min_, _value);
+			this->max_ = std::max(this->max_, _value);
+		};
+
+		uint64_t count() const noexcept { return this->total_; };
+		uint64_t min() const noexcept { return (this->total_ == 0) ? 0 : this->min_; };
+		uint64_t max() const noexcept { return this->max_; };
+		uint64_t sum() const noexcept { return this->sum_; };
+		double mean() const noexcept
+		{
+			return (this->total_ == 0) ? 0.0 : static_cast<double>(this->sum_) / static_cast<double>(this->total_);
+		};
+
+		/**
+		 * @brief Gets the value at a percentile.
+		 * @param _percentile Percentile in [0, 100].
+		 * @return Highest value equivalent to the one at the percentile, within the histogram's precision.
+		*/
+		uint64_t percentile(double _percentile) const noexcept;
+
+		void reset() noexcept
+		{
+			*this = hdr_histogram{};
+		};
+
+		static constexpr size_t index_of(uint64_t _value) noexcept
+		{
+			const auto _bucket = static_cast<size_t>(std::bit_width(_value | (sub_bucket_count - 1))) - sub_bucket_bits;
+			const auto _subBucket = static_cast<size_t>(_value >> _bucket);
+			return (_bucket + 1) * sub_bucket_half + _subBucket - sub_bucket_half;
+		};
+
+		static constexpr uint64_t highest_equivalent_value(size_t _index) noexcept
+		{
+			auto _bucket = static_cast<ptrdiff_t>(_index / sub_bucket_half) - 1;
+			auto _subBucket = static_cast<uint64_t>(_index % sub_bucket_half + sub_bucket_half);
+			if (_bucket < 0)
+			{
+				_subBucket -= sub_bucket_half;
+				_bucket = 0;
+			};
+			return (_subBucket << _bucket) + ((uint64_t(1) << _bucket) - 1);
+		};
+
+	private:
+		std::array<uint64_t, counts_size> counts_{};
+		uint64_t total_ = 0;
+		uint64_t sum_ = 0;
+		uint64_t min_ = UINT64_MAX;
+		uint64_t max_ = 0;
+	};
+
+	/**
+	 * @brief What triggered a collector pause.
+	*/
+	enum class gc_pause_kind : uint8_t
+	{
+		step,		// explicit lua_gc(LUA_GCSTEP), see gc_step
+		full,		// explicit lua_gc(LUA_GCCOLLECT), see gc_collect
+		implicit,	// collection driven by allocation debt
+	};
+
+	/**
+	 * @brief Collector pause statistics of a lua state, gathered by wrapping its allocator.
+	 *
+	 * Explicit collections through gc_step and gc_collect are timed exactly. Implicit pauses are
+	 * detected from the allocator : a collector step frees objects in a burst with no allocation
+	 * in between, the time from the first to the last free of a burst is recorded. Marking work
+	 * performs no allocator calls, so implicit durations are lower bounds.
+	*/
+	class gc_telemetry
+	{
+	public:
+		struct pause_stats
+		{
+			hdr_histogram duration_ns;
+			hdr_histogram bytes_collected;
+		};
+
+		// Bursts with fewer frees are not counted as collector pauses
+		static constexpr size_t min_burst_frees = 4;
+
+		const pause_stats& stats(gc_pause_kind _kind) const noexcept
+		{
+			return this->stats_[static_cast<size_t>(_kind)];
+		};
+
+		void reset() noexcept;
+
+		/**
+		 * @brief Wraps the allocator of a state, the telemetry must stay alive until uninstall or lua::close.
+		*/
+		void install(state_ptr _lua);
+
+		/**
+		 * @brief Restores the allocator the state had when install was called.
+		*/
+		void uninstall(state_ptr _lua);
+
+		gc_telemetry() = default;
+		gc_telemetry(const gc_telemetry&) = delete;
+		gc_telemetry& operator=(const gc_telemetry&) = delete;
+
+	private:
+		friend bool gc_step(state_ptr _lua, int _kilobytes);
+		friend void gc_collect(state_ptr _lua);
+		friend gc_telemetry* get_gc_telemetry(state_ptr _lua);
+
+		static void* allocate(void* _userdata, void* _ptr, size_t _oldSize, size_t _newSize);
+		void end_burst() noexcept;
+		void record(gc_pause_kind _kind, uint64_t _durationNs, uint64_t _bytes) noexcept;
+
+		lua_Alloc alloc_ = nullptr;
+		void* alloc_userdata_ = nullptr;
+
+		bool explicit_ = false;
+		size_t burst_frees_ = 0;
+		size_t burst_bytes_ = 0;
+		int64_t burst_start_ = 0;
+		int64_t burst_end_ = 0;
+
+		std::array<pause_stats, 3> stats_{};
+	};
+
+	/**
+	 * @brief Gets the telemetry installed on a state.
+	 * @return The telemetry, or nullptr if none is installed.
+	*/
+	gc_telemetry* get_gc_telemetry(state_ptr _lua);
+
+	/**
+	 * @brief Performs an incremental collection step, lua_gc(LUA_GCSTEP), timed when telemetry is installed.
+	 * @return True if the step finished a collection cycle.
+	*/
+	bool gc_step(state_ptr _lua, int _kilobytes = 0);
+
+	/**
+	 * @brief Performs a full collection, lua_gc(LUA_GCCOLLECT), timed when telemetry is installed.
+	*/
+	void gc_collect(state_ptr _lua);
+};
+#pragma endregion
+
+
+
+/*
+	Hook multiplexing
+*/
+
+#pragma region HOOK_MULTIPLEXER
+namespace lua
+{
+	/**
+	 * @brief Hook subscriber, called with the userdata given to add_hook.
+	*/
+	using hook_function = void(*)(state_ptr _lua, lua_Debug* _info, void* _userdata);
+
+	// Maximum number of subscribers sharing the hook of a state
+	constexpr inline size_t max_hook_subscribers = 8;
+
+	/**
+	 * @brief Subscribes to the hook of a state.
+	 *
+	 * Lua allows a single hook per state, subscribers share it : the installed mask is the union of their
+	 * masks and count hooks fire every gcd of their counts, each subscriber only sees the events it asked for.
+	 *
+	 * The hook is set on the main thread and _lua, threads created afterwards inherit it. Lua cannot list the
+	 * other threads of a state, coroutines which already exist only get the hook through sync_hook. Threads
+	 * holding an outdated hook update it themselves on their next hook event, removing it if no subscriber is left.
+	 *
+	 * @param _mask Combination of LUA_MASKCALL, LUA_MASKRET, LUA_MASKLINE and LUA_MASKCOUNT.
+	 * @param _count Instruction count interval, used with LUA_MASKCOUNT.
+	 * @return False if the subscriber is already registered or all slots are taken.
+	*/
+	bool add_hook(state_ptr _lua, hook_function _function, void* _userdata, int _mask, int _count = 0);
+
+	/**
+	 * @brief Unsubscribes from the hook of a state, the hook is removed with the last subscriber.
+	 * @return False if the subscriber was not registered.
+	*/
+	bool remove_hook(state_ptr _lua, hook_function _function, void* _userdata);
+
+	/**
+	 * @brief Sets the hook of a thread to match the current subscribers of its state.
+	 *
+	 * Needed for coroutines created before add_hook was called, ie. to enforce an instruction count
+	 * limit in every coroutine that is resumed.
+	 *
+	 * @param _thread Thread to update.
+	*/
+	void sync_hook(state_ptr _thread);
+};
+#pragma endregion
+
+
+
+/*
+	Hardware performance counters
+*/
+
+#pragma region PERF_COUNTERS
+namespace lua
+{
+	/**
+	 * @brief Counters read by perf_counters.
+	*/
+	enum class perf_counter : uint8_t
+	{
+		cycles,
+		instructions,
+		cache_misses,
+		branch_misses,
+
+		// Software counter in nanoseconds, available where the hardware counters are not (ie. virtual machines)
+		task_clock,
+	};
+	constexpr inline size_t perf_counter_count = 5;
+
+	/**
+	 * @brief Values of each perf_counter, either absolute or a difference between two reads.
+	*/
+	struct perf_sample
+	{
+		std::array<uint64_t, perf_counter_count> values{};
+
+		uint64_t& operator[](perf_counter _counter) noexcept { return this->values[static_cast<size_t>(_counter)]; };
+		const uint64_t& operator[](perf_counter _counter) const noexcept { return this->values[static_cast<size_t>(_counter)]; };
+
+		perf_sample& operator+=(const perf_sample& rhs) noexcept
+		{
+			for (size_t n = 0; n != perf_counter_count; ++n)
+			{
+				this->values[n] += rhs.values[n];
+			};
+			return *this;
+		};
+		perf_sample& operator-=(const perf_sample& rhs) noexcept
+		{
+			for (size_t n = 0; n != perf_counter_count; ++n)
+			{
+				this->values[n] -= rhs.values[n];
+			};
+			return *this;
+		};
+		friend perf_sample operator+(perf_sample lhs, const perf_sample& rhs) noexcept { return lhs += rhs; };
+		friend perf_sample operator-(perf_sample lhs, const perf_sample& rhs) noexcept { return lhs -= rhs; };
+
+		/**
+		 * @brief Instructions per cycle, 0 if no cycles were counted.
+		*/
+		double ipc() const noexcept
+		{
+			const auto _cycles = (*this)[perf_counter::cycles];
+			return (_cycles == 0) ? 0.0 : static_cast<double>((*this)[perf_counter::instructions]) / static_cast<double>(_cycles);
+		};
+	};
+
+	/**
+	 * @brief Per thread performance counters opened with perf_event_open, counting user space only.
+	 *
+	 * Counters are read with rdpmc when the kernel allows it (x86-64), otherwise with read(2).
+	 * Counters that cannot be opened, and all counters on other platforms than linux, read as 0.
+	*/
+	class perf_counters
+	{
+	public:
+		bool available() const noexcept;
+		bool available(perf_counter _counter) const noexcept
+		{
+			return this->fds_[static_cast<size_t>(_counter)] != -1;
+		};
+
+		/**
+		 * @brief Checks if a counter is read from user space without a system call.
+		*/
+		bool uses_rdpmc(perf_counter _counter) const noexcept;
+
+		perf_sample read() const noexcept;
+
+		perf_counters();
+		perf_counters(const perf_counters&) = delete;
+		perf_counters& operator=(const perf_counters&) = delete;
+		~perf_counters();
+
+	private:
+		std::array<int, perf_counter_count> fds_;
+		std::array<void*, perf_counter_count> pages_{};
+	};
+
+	/**
+	 * @brief Attributes performance counters to lua functions, bindings included, through the call and return hooks.
+	 *
+	 * The profiler subscribes to the hook of the state through add_hook, threads created afterwards inherit it.
+	*/
+	class perf_profiler
+	{
+	public:
+		struct entry
+		{
+			std::string name;
+			uint64_t calls = 0;
+
+			// Counts including the functions called from this one
+			perf_sample inclusive{};
+
+			// Counts excluding the functions called from this one
+			perf_sample self{};
+		};
+
+		void install(state_ptr _lua);
+		void uninstall(state_ptr _lua);
+
+		const perf_counters& counters() const noexcept { return this->counters_; };
+
+		/**
+		 * @brief Gets the entries of functions and scopes, sorted by inclusive cycles (task clock without cycles).
+		*/
+		std::vector<entry> entries() const;
+
+		/**
+		 * @brief Formats the top entries as a table with IPC and miss rates.
+		*/
+		std::string report(size_t _limit = 20) const;
+
+		void reset();
+
+		perf_profiler() = default;
+		perf_profiler(const perf_profiler&) = delete;
+		perf_profiler& operator=(const perf_profiler&) = delete;
+
+	private:
+		friend class perf_scope;
+
+		// Lua functions are identified by their source and first line, C functions by their address
+		struct function_key
+		{
+			const void* id;
+			int line;
+			bool operator==(const function_key&) const = default;
+		};
+		struct function_key_hash
+		{
+			size_t operator()(const function_key& _key) const noexcept
+			{
+				return std::hash<const void*>{}(_key.id) ^ (static_cast<size_t>(_key.line) * 0x9E3779B97F4A7C15);
+			};
+		};
+
+		struct frame
+		{
+			entry* target;
+			const void* function;
+			perf_sample start;
+			perf_sample children;
+		};
+
+		static void hook(state_ptr _lua, lua_Debug* _info, void* _userdata);
+		void dispatch(state_ptr _lua, lua_Debug* _info, const function_key& _key, const void* _function, const perf_sample& _now);
+		void enter(std::vector<frame>& _stack, entry& _target, const void* _function);
+		void leave(std::vector<frame>& _stack, const perf_sample& _now);
+
+		perf_counters counters_{};
+		std::unordered_map<function_key, entry, function_key_hash> functions_{};
+		std::unordered_map<std::string, entry> scopes_{};
+		std::unordered_map<state_ptr, std::vector<frame>> stacks_{};
+		std::vector<frame> scope_stack_{};
+	};
+
+	/**
+	 * @brief Attributes the counts of a region, ie. a lua::pcall or lua::resume, to a named profiler entry.
+	*/
+	class perf_scope
+	{
+	public:
+		perf_scope(perf_profiler& _profiler, std::string_view _name);
+		perf_scope(const perf_scope&) = delete;
+		perf_scope& operator=(const perf_scope&) = delete;
+		~perf_scope();
+
+	private:
+		perf_profiler* profiler_;
+	};
+};
+#pragma endregion
+
+
+
 /*
 	Debugging related functionality
 */
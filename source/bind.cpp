@@ -0,0 +1,80 @@
+#include <luacpp.hpp>
+
+#include <cstdlib>
+
+namespace lua::impl
+{
+	uint32_t filter_usertype_overloads(state_ptr _lua, int _index, uint32_t _mask, const param_info* _params, size_t _stride)
+	{
+		if (!lua_getmetatable(_lua, _index))
+		{
+			lua_pushnil(_lua);
+		};
+		const auto _metatable = top(_lua);
+
+		uint32_t _exact = 0;
+		uint32_t _bases = 0;
+		for (auto _remaining = _mask; _remaining != 0; _remaining &= _remaining - 1)
+		{
+			const auto _overload = static_cast<size_t>(std::countr_zero(_remaining));
+			const auto _bit = uint32_t(1) << _overload;
+			const auto& _param = _params[_overload * _stride];
+			const auto _key = const_cast<void*>(_param.usertype);
+			if (!_key)
+			{
+				if (!_param.accepts || _param.accepts(_lua, _index))
+				{
+					_exact |= _bit;
+				};
+				continue;
+			};
+
+			// Cast entries of usertype metatables, see to_usertype
+			if (lua_istable(_lua, _metatable) && rawget(_lua, _metatable, _key) == type::number)
+			{
+				((lua_tointeger(_lua, -1) & usertype_base_cast_bit) ? _bases : _exact) |= _bit;
+				pop(_lua);
+				continue;
+			};
+			pop(_lua);
+
+			rawget(_lua, LUA_REGISTRYINDEX, _key);
+			if (lua_rawequal(_lua, -1, _metatable))
+			{
+				_exact |= _bit;
+			};
+			pop(_lua);
+		};
+
+		pop(_lua);
+		return (_exact != 0) ? _exact : _bases;
+	};
+
+	void no_matching_overload(state_ptr _lua)
+	{
+		const auto _count = top(_lua);
+		luaL_Buffer _buffer{};
+		luaL_buffinit(_lua, &_buffer);
+		for (int n = 1; n <= _count; ++n)
+		{
+			if (n != 1)
+			{
+				luaL_addstring(&_buffer, ", ");
+			};
+			const auto _nameType = luaL_getmetafield(_lua, n, "__name");
+			if (_nameType == LUA_TSTRING)
+			{
+				luaL_addvalue(&_buffer);
+				continue;
+			};
+			if (_nameType != LUA_TNIL)
+			{
+				pop(_lua);
+			};
+			luaL_addstring(&_buffer, luaL_typename(_lua, n));
+		};
+		luaL_pushresult(&_buffer);
+		luaL_error(_lua, "no matching overload for arguments (%s)", lua_tostring(_lua, -1));
+		std::abort();
+	};
+};
@@ -0,0 +1,369 @@
+#include <luacpp.hpp>
+
+#include "byte_access.hpp"
+
+#include <new>
+#include <limits>
+
+namespace lua
+{
+	namespace
+	{
+		/*
+			"buffer" userdata layout : a byte_buffer.
+		*/
+
+		byte_buffer& check_buffer(state_ptr _lua, int _index)
+		{
+			const auto _buffer = testudata<byte_buffer>(_lua, _index);
+			if (!_buffer)
+			{
+				luaL_typeerror(_lua, _index, "buffer");
+			};
+			return *_buffer;
+		};
+
+		// Gets a whole buffer, slices have a fixed size and cannot be appended to.
+		byte_buffer::storage_type& check_growable(state_ptr _lua, int _index)
+		{
+			auto& _buffer = check_buffer(_lua, _index);
+			if (_buffer.is_slice())
+			{
+				luaL_error(_lua, "cannot resize a buffer slice");
+			};
+			return *_buffer.storage;
+		};
+
+		std::span<const std::byte> check_buffer_span(state_ptr _lua, int _index)
+		{
+			return check_buffer(_lua, _index).span();
+		};
+
+		/**
+		 * @brief Grows storage by _count bytes.
+		 * @return Pointer to the first new byte, or nullptr if out of memory.
+		*/
+		std::byte* grow(byte_buffer::storage_type& _storage, size_t _count) noexcept
+		{
+			const auto _offset = _storage.size();
+			try
+			{
+				// Vector growth is geometric, keeping appends amortised O(1)
+				_storage.resize(_offset + _count);
+			}
+			catch (const std::bad_alloc&)
+			{
+				return nullptr;
+			};
+			return _storage.data() + _offset;
+		};
+
+		int buffer_len(state_ptr _lua)
+		{
+			lua_pushinteger(_lua, static_cast<lua_Integer>(check_buffer(_lua, 1).span().size()));
+			return 1;
+		};
+
+		int buffer_gc(state_ptr _lua)
+		{
+			destroy_udata<byte_buffer>(_lua, 1, "buffer");
+			return 0;
+		};
+
+		// (self, value...) -> self, appends strings, bytes and buffers
+		int buffer_append(state_ptr _lua)
+		{
+			auto& _storage = check_growable(_lua, 1);
+			const auto _top = top(_lua);
+			for (int n = 2; n <= _top; ++n)
+			{
+				// Appending a buffer to itself, or a slice of it, must survive the storage reallocating
+				auto _source = std::span<const std::byte>{};
+				auto _aliasOffset = byte_buffer::npos;
+				if (const auto _buffer = tobuffer(_lua, n); _buffer)
+				{
+					_source = _buffer->span();
+					if (_buffer->storage.get() == &_storage)
+					{
+						_aliasOffset = static_cast<size_t>(_source.data() - _storage.data());
+					};
+				}
+				else
+				{
+					const auto _str = impl::check_byte_string(_lua, n);
+					_source = std::as_bytes(std::span<const char>(_str.data(), _str.size()));
+				};
+
+				const auto _dest = grow(_storage, _source.size());
+				if (!_dest)
+				{
+					return luaL_error(_lua, "not enough memory");
+				};
+				if (_aliasOffset != byte_buffer::npos)
+				{
+					_source = std::span<const std::byte>(_storage.data() + _aliasOffset, _source.size());
+				};
+				std::memcpy(_dest, _source.data(), _source.size());
+			};
+			lua_settop(_lua, 1);
+			return 1;
+		};
+
+		// (self [, i [, j]]) -> buffer, slice sharing this buffer's storage
+		int buffer_slice(state_ptr _lua)
+		{
+			const auto& _buffer = check_buffer(_lua, 1);
+			const auto _span = _buffer.span();
+			const auto _start = impl::posrelat_start(luaL_optinteger(_lua, 2, 1), _span.size());
+			const auto _end = impl::posrelat_end(luaL_optinteger(_lua, 3, -1), _span.size());
+
+			auto _slice = byte_buffer{ _buffer.storage, static_cast<size_t>(_span.data() - _buffer.storage->data()), 0 };
+			if (_start <= _end)
+			{
+				_slice.offset += _start - 1;
+				_slice.length = _end - _start + 1;
+			};
+			push_buffer(_lua, std::move(_slice));
+			return 1;
+		};
+
+		// (self [, i [, j]]) -> integer...
+		int buffer_byte(state_ptr _lua)
+		{
+			return impl::push_byte_values(_lua, check_buffer_span(_lua, 1), 2);
+		};
+
+		// (self, needle [, init]) -> start, end | fail
+		int buffer_find(state_ptr _lua)
+		{
+			const auto _span = check_buffer_span(_lua, 1);
+			const auto _haystack = std::string_view(reinterpret_cast<const char*>(_span.data()), _span.size());
+			const auto _needle = impl::check_byte_string(_lua, 2);
+			return impl::find_bytes(_lua, _haystack, _needle, 3);
+		};
+
+		// (self [, i [, j]]) -> string, copies the given range into a lua string
+		int buffer_string(state_ptr _lua)
+		{
+			const auto _span = check_buffer_span(_lua, 1);
+			const auto _start = impl::posrelat_start(luaL_optinteger(_lua, 2, 1), _span.size());
+			const auto _end = impl::posrelat_end(luaL_optinteger(_lua, 3, -1), _span.size());
+			if (_start > _end)
+			{
+				lua_pushliteral(_lua, "");
+			}
+			else
+			{
+				lua_pushlstring(_lua, reinterpret_cast<const char*>(_span.data()) + (_start - 1), _end - _start + 1);
+			};
+			return 1;
+		};
+
+		// (self) -> self, empties the buffer but keeps its capacity
+		int buffer_clear(state_ptr _lua)
+		{
+			check_growable(_lua, 1).clear();
+			lua_settop(_lua, 1);
+			return 1;
+		};
+
+		// (self, capacity) -> self
+		int buffer_reserve(state_ptr _lua)
+		{
+			auto& _storage = check_growable(_lua, 1);
+			const auto _capacity = luaL_checkinteger(_lua, 2);
+			luaL_argcheck(_lua, _capacity >= 0, 2, "capacity must be positive");
+
+			bool _ok = true;
+			try
+			{
+				_storage.reserve(static_cast<size_t>(_capacity));
+			}
+			catch (const std::exception&)
+			{
+				_ok = false;
+			};
+			if (!_ok)
+			{
+				return luaL_error(_lua, "not enough memory");
+			};
+			lua_settop(_lua, 1);
+			return 1;
+		};
+
+		// (self) -> integer
+		int buffer_capacity(state_ptr _lua)
+		{
+			const auto& _buffer = check_buffer(_lua, 1);
+			const auto _capacity = (_buffer.is_slice()) ? _buffer.span().size() : _buffer.storage->capacity();
+			lua_pushinteger(_lua, static_cast<lua_Integer>(_capacity));
+			return 1;
+		};
+
+		template <typename T>
+		T check_value(state_ptr _lua, int _arg)
+		{
+			if constexpr (std::is_floating_point_v<T>)
+			{
+				return static_cast<T>(luaL_checknumber(_lua, _arg));
+			}
+			else
+			{
+				const auto _value = luaL_checkinteger(_lua, _arg);
+				if constexpr (sizeof(T) < sizeof(lua_Integer))
+				{
+					luaL_argcheck(_lua, _value >= static_cast<lua_Integer>(std::numeric_limits<T>::min()) &&
+						_value <= static_cast<lua_Integer>(std::numeric_limits<T>::max()), _arg, "integer overflow");
+				};
+				return static_cast<T>(_value);
+			};
+		};
+
+		// (self, value) -> self, appends a typed value
+		template <typename T, std::endian Order>
+		int write_method(state_ptr _lua)
+		{
+			auto& _storage = check_growable(_lua, 1);
+			const auto _value = check_value<T>(_lua, 2);
+			const auto _dest = grow(_storage, sizeof(T));
+			if (!_dest)
+			{
+				return luaL_error(_lua, "not enough memory");
+			};
+			impl::store_bytes<T>(_dest, _value, Order);
+			lua_settop(_lua, 1);
+			return 1;
+		};
+
+		// (self, offset, value) -> self, overwrites a typed value in place
+		template <typename T, std::endian Order>
+		int set_method(state_ptr _lua)
+		{
+			const auto _span = check_buffer(_lua, 1).span();
+			const auto _offset = impl::check_offset(_lua, 2, _span.size(), sizeof(T));
+			impl::store_bytes<T>(_span.data() + _offset, check_value<T>(_lua, 3), Order);
+			lua_settop(_lua, 1);
+			return 1;
+		};
+
+		template <typename T, std::endian Order>
+		constexpr std::array<luaL_Reg, 2> typed_methods(const char* _writeName, const char* _setName)
+		{
+			return { luaL_Reg{ _writeName, &write_method<T, Order> }, luaL_Reg{ _setName, &set_method<T, Order> } };
+		};
+
+		// Typed writers, write_<type> appends and set_<type> overwrites at an offset
+		constexpr std::array<std::array<luaL_Reg, 2>, 18> buffer_writer_methods =
+		{
+			typed_methods<uint8_t, std::endian::little>("write_u8", "set_u8"),
+			typed_methods<int8_t, std::endian::little>("write_i8", "set_i8"),
+			typed_methods<uint16_t, std::endian::little>("write_u16le", "set_u16le"),
+			typed_methods<uint16_t, std::endian::big>("write_u16be", "set_u16be"),
+			typed_methods<int16_t, std::endian::little>("write_i16le", "set_i16le"),
+			typed_methods<int16_t, std::endian::big>("write_i16be", "set_i16be"),
+			typed_methods<uint32_t, std::endian::little>("write_u32le", "set_u32le"),
+			typed_methods<uint32_t, std::endian::big>("write_u32be", "set_u32be"),
+			typed_methods<int32_t, std::endian::little>("write_i32le", "set_i32le"),
+			typed_methods<int32_t, std::endian::big>("write_i32be", "set_i32be"),
+			typed_methods<uint64_t, std::endian::little>("write_u64le", "set_u64le"),
+			typed_methods<uint64_t, std::endian::big>("write_u64be", "set_u64be"),
+			typed_methods<int64_t, std::endian::little>("write_i64le", "set_i64le"),
+			typed_methods<int64_t, std::endian::big>("write_i64be", "set_i64be"),
+			typed_methods<float, std::endian::little>("write_f32le", "set_f32le"),
+			typed_methods<float, std::endian::big>("write_f32be", "set_f32be"),
+			typed_methods<double, std::endian::little>("write_f64le", "set_f64le"),
+			typed_methods<double, std::endian::big>("write_f64be", "set_f64be"),
+		};
+
+		constexpr luaL_Reg buffer_methods[] =
+		{
+			{ "append", &buffer_append },
+			{ "slice", &buffer_slice },
+			{ "byte", &buffer_byte },
+			{ "find", &buffer_find },
+			{ "string", &buffer_string },
+			{ "clear", &buffer_clear },
+			{ "reserve", &buffer_reserve },
+			{ "capacity", &buffer_capacity },
+			{ nullptr, nullptr }
+		};
+
+		void init_buffer_metatable(state_ptr _lua, int _metatableIndex)
+		{
+			constexpr auto& _readers = impl::byte_reader_methods<&check_buffer_span>;
+
+			// Methods table
+			lua_createtable(_lua, 0, static_cast<int>(std::size(buffer_methods) + _readers.size() + buffer_writer_methods.size() * 2));
+			luaL_setfuncs(_lua, buffer_methods, 0);
+			for (auto& _reader : _readers)
+			{
+				lua_pushcfunction(_lua, _reader.func);
+				lua_setfield(_lua, -2, _reader.name);
+			};
+			for (auto& _writers : buffer_writer_methods)
+			{
+				for (auto& _writer : _writers)
+				{
+					lua_pushcfunction(_lua, _writer.func);
+					lua_setfield(_lua, -2, _writer.name);
+				};
+			};
+			lua_setfield(_lua, _metatableIndex, "__index");
+
+			lua_pushcfunction(_lua, &buffer_len);
+			lua_setfield(_lua, _metatableIndex, "__len");
+			lua_pushcfunction(_lua, &buffer_gc);
+			lua_setfield(_lua, _metatableIndex, "__gc");
+			lua_pushliteral(_lua, "buffer");
+			lua_setfield(_lua, _metatableIndex, "__name");
+			lua_pushboolean(_lua, false);
+			lua_setfield(_lua, _metatableIndex, "__metatable");
+		};
+
+
+
+		// ([capacity]) -> buffer
+		int buffer_new(state_ptr _lua)
+		{
+			const auto _capacity = luaL_optinteger(_lua, 1, 0);
+			luaL_argcheck(_lua, _capacity >= 0, 1, "capacity must be positive");
+
+			push_buffer(_lua, byte_buffer{});
+			lua_pushcfunction(_lua, &buffer_reserve);
+			lua_pushvalue(_lua, -2);
+			lua_pushinteger(_lua, _capacity);
+			lua_call(_lua, 2, 0);
+			return 1;
+		};
+
+		constexpr luaL_Reg buffer_functions[] =
+		{
+			{ "new", &buffer_new },
+			{ nullptr, nullptr }
+		};
+	};
+
+
+
+	void push_buffer(state_ptr _lua, byte_buffer _buffer)
+	{
+		if (!_buffer.storage)
+		{
+			_buffer.storage = std::make_shared<byte_buffer::storage_type>();
+		};
+		new (newuserdata(_lua, sizeof(byte_buffer), 0)) byte_buffer(std::move(_buffer));
+		get_or_create_metatable<byte_buffer>(_lua, &init_buffer_metatable);
+		setmetatable(_lua, -2);
+	};
+
+	byte_buffer* tobuffer(state_ptr _lua, int _index)
+	{
+		return testudata<byte_buffer>(_lua, _index);
+	};
+
+	int open_buffer(state_ptr _lua)
+	{
+		luaL_newlib(_lua, buffer_functions);
+		return 1;
+	};
+};
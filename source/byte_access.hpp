@@ -0,0 +1,200 @@
+#pragma once
+
+/*
+	Helpers shared by the byte oriented userdata types (bytes, buffer).
+*/
+
+#include <luacpp.hpp>
+
+#include <bit>
+#include <span>
+#include <array>
+
+#include <climits>
+
+namespace lua::impl
+{
+	/**
+	 * @brief Converts a relative start position the way lua's string library does.
+	 * @return 1-based position clamped to [1, inf).
+	*/
+	inline size_t posrelat_start(lua_Integer _pos, size_t _len)
+	{
+		if (_pos > 0)
+		{
+			return static_cast<size_t>(_pos);
+		}
+		else if (_pos == 0)
+		{
+			return 1;
+		}
+		else if (_pos < -static_cast<lua_Integer>(_len))
+		{
+			return 1;
+		}
+		else
+		{
+			return _len + static_cast<size_t>(_pos) + 1;
+		};
+	};
+
+	/**
+	 * @brief Converts a relative end position the way lua's string library does.
+	 * @return 1-based position clamped to [0, _len].
+	*/
+	inline size_t posrelat_end(lua_Integer _pos, size_t _len)
+	{
+		if (_pos > static_cast<lua_Integer>(_len))
+		{
+			return _len;
+		}
+		else if (_pos >= 0)
+		{
+			return static_cast<size_t>(_pos);
+		}
+		else if (_pos < -static_cast<lua_Integer>(_len))
+		{
+			return 0;
+		}
+		else
+		{
+			return _len + static_cast<size_t>(_pos) + 1;
+		};
+	};
+
+	/**
+	 * @brief Checks an offset argument for reading or writing _count bytes.
+	 *
+	 * Offsets are 1-based, negative offsets count from the end.
+	 *
+	 * @return 0-based offset of the first byte.
+	*/
+	inline size_t check_offset(state_ptr _lua, int _arg, size_t _len, size_t _count)
+	{
+		auto _pos = luaL_checkinteger(_lua, _arg);
+		if (_pos < 0)
+		{
+			_pos += static_cast<lua_Integer>(_len) + 1;
+		};
+		luaL_argcheck(_lua, _pos >= 1 && static_cast<size_t>(_pos - 1) <= _len && _count <= _len - static_cast<size_t>(_pos - 1),
+			_arg, "offset out of range");
+		return static_cast<size_t>(_pos - 1);
+	};
+
+	template <typename T>
+	inline void push_number(state_ptr _lua, T _value)
+	{
+		if constexpr (std::is_floating_point_v<T>)
+		{
+			lua_pushnumber(_lua, static_cast<lua_Number>(_value));
+		}
+		else
+		{
+			lua_pushinteger(_lua, static_cast<lua_Integer>(_value));
+		};
+	};
+
+	/**
+	 * @brief Typed reader method, (self, offset) -> value.
+	 * @tparam GetFn Gets the readable bytes of self, signature : std::span<const std::byte>(state_ptr, int)
+	*/
+	template <auto GetFn, typename T, std::endian Order>
+	inline int read_method(state_ptr _lua)
+	{
+		const std::span<const std::byte> _bytes = GetFn(_lua, 1);
+		const auto _offset = check_offset(_lua, 2, _bytes.size(), sizeof(T));
+		push_number(_lua, load_bytes<T>(_bytes.data() + _offset, Order));
+		return 1;
+	};
+
+	/**
+	 * @brief Typed reader methods named read_<type>[le|be], ie. read_u8, read_i32le, read_f64be.
+	*/
+	template <auto GetFn>
+	constexpr inline auto byte_reader_methods = std::array
+	{
+		luaL_Reg{ "read_u8", &read_method<GetFn, uint8_t, std::endian::little> },
+		luaL_Reg{ "read_i8", &read_method<GetFn, int8_t, std::endian::little> },
+		luaL_Reg{ "read_u16le", &read_method<GetFn, uint16_t, std::endian::little> },
+		luaL_Reg{ "read_u16be", &read_method<GetFn, uint16_t, std::endian::big> },
+		luaL_Reg{ "read_i16le", &read_method<GetFn, int16_t, std::endian::little> },
+		luaL_Reg{ "read_i16be", &read_method<GetFn, int16_t, std::endian::big> },
+		luaL_Reg{ "read_u32le", &read_method<GetFn, uint32_t, std::endian::little> },
+		luaL_Reg{ "read_u32be", &read_method<GetFn, uint32_t, std::endian::big> },
+		luaL_Reg{ "read_i32le", &read_method<GetFn, int32_t, std::endian::little> },
+		luaL_Reg{ "read_i32be", &read_method<GetFn, int32_t, std::endian::big> },
+		luaL_Reg{ "read_u64le", &read_method<GetFn, uint64_t, std::endian::little> },
+		luaL_Reg{ "read_u64be", &read_method<GetFn, uint64_t, std::endian::big> },
+		luaL_Reg{ "read_i64le", &read_method<GetFn, int64_t, std::endian::little> },
+		luaL_Reg{ "read_i64be", &read_method<GetFn, int64_t, std::endian::big> },
+		luaL_Reg{ "read_f32le", &read_method<GetFn, float, std::endian::little> },
+		luaL_Reg{ "read_f32be", &read_method<GetFn, float, std::endian::big> },
+		luaL_Reg{ "read_f64le", &read_method<GetFn, double, std::endian::little> },
+		luaL_Reg{ "read_f64be", &read_method<GetFn, double, std::endian::big> },
+	};
+
+	/**
+	 * @brief Plain (non-pattern) search, (self, needle [, init]) -> start, end | fail.
+	*/
+	inline int find_bytes(state_ptr _lua, std::string_view _haystack, std::string_view _needle, int _initArg)
+	{
+		const auto _init = posrelat_start(luaL_optinteger(_lua, _initArg, 1), _haystack.size());
+		if (_init > _haystack.size() + 1)
+		{
+			luaL_pushfail(_lua);
+			return 1;
+		};
+
+		const auto _pos = _haystack.find(_needle, _init - 1);
+		if (_pos == std::string_view::npos)
+		{
+			luaL_pushfail(_lua);
+			return 1;
+		};
+
+		lua_pushinteger(_lua, static_cast<lua_Integer>(_pos + 1));
+		lua_pushinteger(_lua, static_cast<lua_Integer>(_pos + _needle.size()));
+		return 2;
+	};
+
+	/**
+	 * @brief Pushes the bytes of a range as integers, (self [, i [, j]]) -> ...
+	*/
+	inline int push_byte_values(state_ptr _lua, std::span<const std::byte> _bytes, int _firstArg)
+	{
+		const auto _start = static_cast<lua_Integer>(posrelat_start(luaL_optinteger(_lua, _firstArg, 1), _bytes.size()));
+		const auto _end = static_cast<lua_Integer>(posrelat_end(luaL_optinteger(_lua, _firstArg + 1, _start), _bytes.size()));
+		if (_start > _end)
+		{
+			return 0;
+		};
+
+		luaL_argcheck(_lua, _end - _start < INT_MAX, _firstArg, "range too large");
+		const auto _count = static_cast<int>(_end - _start + 1);
+		luaL_checkstack(_lua, _count, "range too large");
+		for (auto n = _start; n <= _end; ++n)
+		{
+			lua_pushinteger(_lua, std::to_integer<lua_Integer>(_bytes[static_cast<size_t>(n - 1)]));
+		};
+		return _count;
+	};
+
+	/**
+	 * @brief Gets a byte string argument, accepting lua strings, "bytes" and "buffer" userdata.
+	*/
+	inline std::string_view check_byte_string(state_ptr _lua, int _arg)
+	{
+		if (const auto _view = tobytes(_lua, _arg); _view)
+		{
+			return _view->str();
+		};
+		if (const auto _buffer = tobuffer(_lua, _arg); _buffer)
+		{
+			const auto _span = _buffer->span();
+			return std::string_view(reinterpret_cast<const char*>(_span.data()), _span.size());
+		};
+		size_t _len = 0;
+		const auto _str = luaL_checklstring(_lua, _arg, &_len);
+		return std::string_view(_str, _len);
+	};
+};
@@ -0,0 +1,312 @@
+#include <luacpp.hpp>
+
+#include "byte_access.hpp"
+
+#include <cerrno>
+
+#if defined(_WIN32)
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+#endif
+
+namespace lua
+{
+	namespace
+	{
+		/*
+			"bytes" userdata layout : a byte_view, user value 1 anchors lua owned memory (ie. a wrapped string).
+		*/
+
+		byte_view& check_bytes(state_ptr _lua, int _index)
+		{
+			const auto _view = testudata<byte_view>(_lua, _index);
+			if (!_view)
+			{
+				luaL_typeerror(_lua, _index, "bytes");
+			};
+			return *_view;
+		};
+
+		std::span<const std::byte> check_bytes_span(state_ptr _lua, int _index)
+		{
+			const auto& _view = check_bytes(_lua, _index);
+			return std::span<const std::byte>(_view.data, _view.size);
+		};
+
+		// Pushes a view of a sub range of the view at _index, sharing its owner and anchor.
+		void push_subview(state_ptr _lua, int _index, size_t _offset, size_t _count)
+		{
+			const auto& _view = check_bytes(_lua, _index);
+			push_bytes(_lua, byte_view{ _view.data + _offset, _count, _view.owner });
+			lua_getiuservalue(_lua, _index, 1);
+			lua_setiuservalue(_lua, -2, 1);
+		};
+
+		int bytes_len(state_ptr _lua)
+		{
+			lua_pushinteger(_lua, static_cast<lua_Integer>(check_bytes(_lua, 1).size));
+			return 1;
+		};
+
+		int bytes_gc(state_ptr _lua)
+		{
+			destroy_udata<byte_view>(_lua, 1, "bytes");
+			return 0;
+		};
+
+		// (self [, i [, j]]) -> bytes, view of the given range
+		int bytes_sub(state_ptr _lua)
+		{
+			const auto _size = check_bytes(_lua, 1).size;
+			const auto _start = impl::posrelat_start(luaL_optinteger(_lua, 2, 1), _size);
+			const auto _end = impl::posrelat_end(luaL_optinteger(_lua, 3, -1), _size);
+			if (_start > _end)
+			{
+				push_subview(_lua, 1, 0, 0);
+			}
+			else
+			{
+				push_subview(_lua, 1, _start - 1, _end - _start + 1);
+			};
+			return 1;
+		};
+
+		// (self [, i [, j]]) -> integer...
+		int bytes_byte(state_ptr _lua)
+		{
+			return impl::push_byte_values(_lua, check_bytes_span(_lua, 1), 2);
+		};
+
+		// (self, needle [, init]) -> start, end | fail
+		int bytes_find(state_ptr _lua)
+		{
+			const auto _haystack = check_bytes(_lua, 1).str();
+			const auto _needle = impl::check_byte_string(_lua, 2);
+			return impl::find_bytes(_lua, _haystack, _needle, 3);
+		};
+
+		// (self [, i [, j]]) -> string, copies the given range into a lua string
+		int bytes_string(state_ptr _lua)
+		{
+			const auto _str = check_bytes(_lua, 1).str();
+			const auto _start = impl::posrelat_start(luaL_optinteger(_lua, 2, 1), _str.size());
+			const auto _end = impl::posrelat_end(luaL_optinteger(_lua, 3, -1), _str.size());
+			if (_start > _end)
+			{
+				lua_pushliteral(_lua, "");
+			}
+			else
+			{
+				lua_pushlstring(_lua, _str.data() + (_start - 1), _end - _start + 1);
+			};
+			return 1;
+		};
+
+		constexpr luaL_Reg bytes_methods[] =
+		{
+			{ "sub", &bytes_sub },
+			{ "byte", &bytes_byte },
+			{ "find", &bytes_find },
+			{ "string", &bytes_string },
+			{ nullptr, nullptr }
+		};
+
+		void init_bytes_metatable(state_ptr _lua, int _metatableIndex)
+		{
+			constexpr auto& _readers = impl::byte_reader_methods<&check_bytes_span>;
+
+			// Methods table
+			lua_createtable(_lua, 0, static_cast<int>(std::size(bytes_methods) + _readers.size()));
+			luaL_setfuncs(_lua, bytes_methods, 0);
+			for (auto& _reader : _readers)
+			{
+				lua_pushcfunction(_lua, _reader.func);
+				lua_setfield(_lua, -2, _reader.name);
+			};
+			lua_setfield(_lua, _metatableIndex, "__index");
+
+			lua_pushcfunction(_lua, &bytes_len);
+			lua_setfield(_lua, _metatableIndex, "__len");
+			lua_pushcfunction(_lua, &bytes_gc);
+			lua_setfield(_lua, _metatableIndex, "__gc");
+			lua_pushliteral(_lua, "bytes");
+			lua_setfield(_lua, _metatableIndex, "__name");
+			lua_pushboolean(_lua, false);
+			lua_setfield(_lua, _metatableIndex, "__metatable");
+		};
+
+
+
+		// (path) -> bytes | fail, message, errno
+		int bytes_open(state_ptr _lua)
+		{
+			const auto _path = luaL_checkstring(_lua, 1);
+			auto _view = byte_view{};
+			if (!map_file(_path, _view))
+			{
+				return luaL_fileresult(_lua, 0, _path);
+			};
+			push_bytes(_lua, std::move(_view));
+			return 1;
+		};
+
+		// (string) -> bytes, views the string without copying it
+		int bytes_wrap(state_ptr _lua)
+		{
+			size_t _len = 0;
+			const auto _str = luaL_checklstring(_lua, 1, &_len);
+			push_bytes(_lua, byte_view{ reinterpret_cast<const std::byte*>(_str), _len });
+
+			// Anchor the string so it outlives the view
+			lua_pushvalue(_lua, 1);
+			lua_setiuservalue(_lua, -2, 1);
+			return 1;
+		};
+
+		constexpr luaL_Reg bytes_functions[] =
+		{
+			{ "open", &bytes_open },
+			{ "wrap", &bytes_wrap },
+			{ nullptr, nullptr }
+		};
+	};
+
+
+
+	bool map_file(const char* _path, byte_view& _outView)
+	{
+#if defined(_WIN32)
+		// Windows reports through GetLastError, translate the common cases for luaL_fileresult.
+		const auto _setErrno = []()
+		{
+			switch (::GetLastError())
+			{
+			case ERROR_FILE_NOT_FOUND: [[fallthrough]];
+			case ERROR_PATH_NOT_FOUND:
+				errno = ENOENT;
+				break;
+			case ERROR_ACCESS_DENIED:
+				errno = EACCES;
+				break;
+			default:
+				errno = EIO;
+				break;
+			};
+			return false;
+		};
+
+		const HANDLE _file = ::CreateFileA(_path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (_file == INVALID_HANDLE_VALUE)
+		{
+			return _setErrno();
+		};
+
+		LARGE_INTEGER _size{};
+		if (!::GetFileSizeEx(_file, &_size))
+		{
+			::CloseHandle(_file);
+			return _setErrno();
+		};
+		if (_size.QuadPart == 0)
+		{
+			// Empty files cannot be mapped
+			::CloseHandle(_file);
+			_outView = byte_view{};
+			return true;
+		};
+
+		const HANDLE _mapping = ::CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		::CloseHandle(_file);
+		if (!_mapping)
+		{
+			return _setErrno();
+		};
+
+		// The view keeps the mapping object alive
+		const auto _address = ::MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+		::CloseHandle(_mapping);
+		if (!_address)
+		{
+			return _setErrno();
+		};
+
+		_outView.data = static_cast<const std::byte*>(_address);
+		_outView.size = static_cast<size_t>(_size.QuadPart);
+		_outView.owner = std::shared_ptr<const void>(_address, [](const void* _ptr)
+			{
+				::UnmapViewOfFile(_ptr);
+			});
+		return true;
+#else
+		const int _fd = ::open(_path, O_RDONLY | O_CLOEXEC);
+		if (_fd < 0)
+		{
+			return false;
+		};
+
+		struct stat _info {};
+		if (::fstat(_fd, &_info) != 0)
+		{
+			const auto _error = errno;
+			::close(_fd);
+			errno = _error;
+			return false;
+		};
+
+		const auto _size = static_cast<size_t>(_info.st_size);
+		if (_size == 0)
+		{
+			// Empty files cannot be mapped
+			::close(_fd);
+			_outView = byte_view{};
+			return true;
+		};
+
+		// The mapping stays valid once the descriptor is closed
+		const auto _address = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+		const auto _error = errno;
+		::close(_fd);
+		if (_address == MAP_FAILED)
+		{
+			errno = _error;
+			return false;
+		};
+
+		_outView.data = static_cast<const std::byte*>(_address);
+		_outView.size = _size;
+		_outView.owner = std::shared_ptr<const void>(_address, [_size](const void* _ptr)
+			{
+				::munmap(const_cast<void*>(_ptr), _size);
+			});
+		return true;
+#endif
+	};
+
+	void push_bytes(state_ptr _lua, byte_view _view)
+	{
+		new (newuserdata(_lua, sizeof(byte_view), 1)) byte_view(std::move(_view));
+		get_or_create_metatable<byte_view>(_lua, &init_bytes_metatable);
+		setmetatable(_lua, -2);
+	};
+
+	const byte_view* tobytes(state_ptr _lua, int _index)
+	{
+		return testudata<byte_view>(_lua, _index);
+	};
+
+	int open_bytes(state_ptr _lua)
+	{
+		luaL_newlib(_lua, bytes_functions);
+		return 1;
+	};
+};
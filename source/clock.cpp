@@ -0,0 +1,206 @@
+#include <luacpp.hpp>
+
+/*
+	The time stamp counter is read on x86-64, define LUA_CPP_TSC to 0 or 1 to override the detection.
+*/
+#ifndef LUA_CPP_TSC
+	#if defined(__x86_64__) || defined(_M_X64)
+		#define LUA_CPP_TSC 1
+	#else
+		#define LUA_CPP_TSC 0
+	#endif
+#endif
+
+#if LUA_CPP_TSC
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+	#else
+		#include <cpuid.h>
+		#include <x86intrin.h>
+	#endif
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+	#include <time.h>
+#endif
+
+namespace lua
+{
+	namespace
+	{
+		int64_t monotonic_ns() noexcept
+		{
+#if defined(CLOCK_MONOTONIC)
+			auto _time = timespec{};
+			clock_gettime(CLOCK_MONOTONIC, &_time);
+			return static_cast<int64_t>(_time.tv_sec) * 1000000000 + _time.tv_nsec;
+#else
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+		};
+
+		// Checks for a TSC running at a constant rate in all power states
+		bool has_invariant_tsc() noexcept
+		{
+#if LUA_CPP_TSC && defined(_MSC_VER)
+			int _registers[4]{};
+			__cpuid(_registers, 0x80000000);
+			if (static_cast<unsigned>(_registers[0]) < 0x80000007)
+			{
+				return false;
+			};
+			__cpuid(_registers, 0x80000007);
+			return (_registers[3] & (1 << 8)) != 0;
+#elif LUA_CPP_TSC
+			unsigned _eax = 0, _ebx = 0, _ecx = 0, _edx = 0;
+			if (!__get_cpuid(0x80000007, &_eax, &_ebx, &_ecx, &_edx))
+			{
+				return false;
+			};
+			return (_edx & (1u << 8)) != 0;
+#else
+			return false;
+#endif
+		};
+
+		struct tsc_calibration
+		{
+			bool uses_tsc = false;
+			double ticks_per_second = 1e9;
+			double ns_per_tick = 1.0;
+		};
+
+		// Measures the counter against the monotonic clock for a few milliseconds
+		tsc_calibration calibrate_tsc() noexcept
+		{
+			auto _calibration = tsc_calibration{};
+#if LUA_CPP_TSC
+			if (!has_invariant_tsc())
+			{
+				return _calibration;
+			};
+
+			constexpr int64_t _windowNs = 10000000;
+			const auto _startNs = monotonic_ns();
+			const auto _startTicks = __rdtsc();
+			auto _endNs = _startNs;
+			while (_endNs - _startNs < _windowNs)
+			{
+				_endNs = monotonic_ns();
+			};
+			const auto _endTicks = __rdtsc();
+
+			_calibration.uses_tsc = true;
+			_calibration.ticks_per_second = static_cast<double>(_endTicks - _startTicks) * 1e9 / static_cast<double>(_endNs - _startNs);
+			_calibration.ns_per_tick = 1e9 / _calibration.ticks_per_second;
+#endif
+			return _calibration;
+		};
+
+		const tsc_calibration& get_tsc_calibration() noexcept
+		{
+			static const auto _calibration = calibrate_tsc();
+			return _calibration;
+		};
+
+
+
+		// () -> integer nanoseconds
+		int clock_monotonic(state_ptr _lua)
+		{
+			lua_pushinteger(_lua, monotonic_ns());
+			return 1;
+		};
+
+		// () -> integer nanoseconds
+		int clock_coarse(state_ptr _lua)
+		{
+			push(_lua, coarse_clock::now());
+			return 1;
+		};
+
+		// () -> integer nanoseconds since the unix epoch
+		int clock_realtime(state_ptr _lua)
+		{
+			push(_lua, std::chrono::system_clock::now(), time_encoding::nanoseconds);
+			return 1;
+		};
+
+		// () -> integer ticks
+		int clock_ticks(state_ptr _lua)
+		{
+			lua_pushinteger(_lua, static_cast<lua_Integer>(tsc_clock::ticks()));
+			return 1;
+		};
+
+		// () -> ticks per second, uses tsc
+		int clock_tick_rate(state_ptr _lua)
+		{
+			lua_pushnumber(_lua, tsc_clock::ticks_per_second());
+			lua_pushboolean(_lua, tsc_clock::uses_tsc());
+			return 2;
+		};
+
+		constexpr auto clock_module = module_definition{ "clock",
+			{
+				{ "monotonic", &clock_monotonic, 0, 0 },
+				{ "coarse", &clock_coarse, 0, 0 },
+				{ "realtime", &clock_realtime, 0, 0 },
+				{ "ticks", &clock_ticks, 0, 0 },
+				{ "tick_rate", &clock_tick_rate, 0, 0 },
+			} };
+	};
+
+
+
+	coarse_clock::time_point coarse_clock::now() noexcept
+	{
+#if defined(CLOCK_MONOTONIC_COARSE)
+		auto _time = timespec{};
+		clock_gettime(CLOCK_MONOTONIC_COARSE, &_time);
+		return time_point(duration(static_cast<rep>(_time.tv_sec) * 1000000000 + _time.tv_nsec));
+#else
+		return time_point(duration(monotonic_ns()));
+#endif
+	};
+
+	uint64_t tsc_clock::ticks() noexcept
+	{
+#if LUA_CPP_TSC
+		if (get_tsc_calibration().uses_tsc)
+		{
+			return __rdtsc();
+		};
+#endif
+		return static_cast<uint64_t>(monotonic_ns());
+	};
+
+	double tsc_clock::ticks_per_second() noexcept
+	{
+		return get_tsc_calibration().ticks_per_second;
+	};
+
+	bool tsc_clock::uses_tsc() noexcept
+	{
+		return get_tsc_calibration().uses_tsc;
+	};
+
+	void tsc_clock::calibrate() noexcept
+	{
+		(void)get_tsc_calibration();
+	};
+
+	tsc_clock::time_point tsc_clock::now() noexcept
+	{
+		const auto _ticks = static_cast<double>(ticks());
+		return time_point(duration(static_cast<rep>(_ticks * get_tsc_calibration().ns_per_tick)));
+	};
+
+	int open_clock(state_ptr _lua)
+	{
+		tsc_clock::calibrate();
+		push_module(_lua, clock_module);
+		return 1;
+	};
+};
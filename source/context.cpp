@@ -0,0 +1,64 @@
+#include <luacpp.hpp>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+
+namespace lua::impl
+{
+	namespace
+	{
+		void cache_context_block(state_ptr _lua, context_block* _block) noexcept
+		{
+			if constexpr (LUA_EXTRASPACE >= sizeof(void*))
+			{
+				std::memcpy(lua_getextraspace(_lua), &_block, sizeof(void*));
+			};
+		};
+	};
+
+	size_t next_context_index() noexcept
+	{
+		static std::atomic<size_t> _next{ 0 };
+		const auto _index = _next.fetch_add(1, std::memory_order_relaxed);
+
+		// Indices are used unchecked by context and set_context, this must stop release builds too
+		if (_index >= max_context_types)
+		{
+			std::fputs("lua::context : more than max_context_types context types\n", stderr);
+			std::abort();
+		};
+		return _index;
+	};
+
+	context_block* find_context_block(state_ptr _lua) noexcept
+	{
+		rawget(_lua, LUA_REGISTRYINDEX, type_key<context_block>());
+		const auto _block = static_cast<context_block*>(lua_touserdata(_lua, -1));
+		pop(_lua);
+		if (_block)
+		{
+			cache_context_block(_lua, _block);
+		};
+		return _block;
+	};
+
+	context_block& get_or_create_context_block(state_ptr _lua)
+	{
+		// The extra space is not trusted here, states created without lua::newstate hold garbage in it
+		if (const auto _block = find_context_block(_lua); _block)
+		{
+			return *_block;
+		};
+
+		const auto _block = new (newuserdata(_lua, sizeof(context_block), 0)) context_block{};
+		rawset(_lua, LUA_REGISTRYINDEX, type_key<context_block>());
+		cache_context_block(_lua, _block);
+
+		// The main thread is the one threads created by lua_newthread copy their extra space from
+		lua_rawgeti(_lua, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+		cache_context_block(lua_tothread(_lua, -1), _block);
+		pop(_lua);
+		return *_block;
+	};
+};
@@ -0,0 +1,101 @@
+#include <luacpp.hpp>
+
+#include <cstdlib>
+
+namespace lua
+{
+	namespace
+	{
+		// Name of the value's type for messages, using __name like luaL_typeerror
+		const char* type_name(state_ptr _lua, const conversion_error& _error)
+		{
+			if (_error.type == LUA_TNONE)
+			{
+				return "no value";
+			};
+			if (luaL_getmetafield(_lua, _error.index, "__name") == LUA_TSTRING)
+			{
+				return lua_tostring(_lua, -1);
+			};
+			if (_error.type == LUA_TLIGHTUSERDATA)
+			{
+				return "light userdata";
+			};
+			return lua_typename(_lua, _error.type);
+		};
+	};
+
+	const char* push_conversion_error(state_ptr _lua, const conversion_error& _error)
+	{
+		switch (_error.code)
+		{
+		case conversion_errc::not_an_integer:
+			return lua_pushstring(_lua, "number has no integer representation");
+		case conversion_errc::out_of_range:
+			return lua_pushstring(_lua, "value out of range");
+		case conversion_errc::invalid_name:
+			return lua_pushfstring(_lua, "invalid option '%s'", lua_tostring(_lua, _error.index));
+		case conversion_errc::expired:
+			return lua_pushstring(_lua, "attempt to access an expired view");
+		case conversion_errc::misaligned:
+			return lua_pushstring(_lua, "bytes are misaligned or not a whole number of elements");
+		default:
+		{
+			// The __name field stays on the stack until formatted
+			const auto _top = top(_lua);
+			const auto _message = lua_pushfstring(_lua, "%s expected, got %s",
+				(_error.expected) ? _error.expected : "value", type_name(_lua, _error));
+			if (top(_lua) != _top + 1)
+			{
+				lua_remove(_lua, -2);
+			};
+			return _message;
+		};
+		};
+	};
+
+	namespace impl
+	{
+		void raise_argument_errors(state_ptr _lua, const conversion_error* _errors, size_t _count)
+		{
+			// Named and numbered like luaL_argerror, methods do not count self
+			auto _info = lua_Debug{};
+			const char* _name = "?";
+			bool _method = false;
+			if (lua_getstack(_lua, 0, &_info))
+			{
+				lua_getinfo(_lua, "n", &_info);
+				_name = (_info.name) ? _info.name : "?";
+				_method = _info.namewhat && std::strcmp(_info.namewhat, "method") == 0;
+			};
+
+			luaL_Buffer _buffer{};
+			luaL_buffinit(_lua, &_buffer);
+			luaL_where(_lua, 1);
+			luaL_addvalue(&_buffer);
+			for (size_t n = 0; n != _count; ++n)
+			{
+				if (n != 0)
+				{
+					luaL_addstring(&_buffer, "; ");
+				};
+
+				const auto _arg = _errors[n].index - ((_method) ? 1 : 0);
+				push_conversion_error(_lua, _errors[n]);
+				if (_arg == 0)
+				{
+					lua_pushfstring(_lua, "calling '%s' on bad self (%s)", _name, lua_tostring(_lua, -1));
+				}
+				else
+				{
+					lua_pushfstring(_lua, "bad argument #%d to '%s' (%s)", _arg, _name, lua_tostring(_lua, -1));
+				};
+				lua_remove(_lua, -2);
+				luaL_addvalue(&_buffer);
+			};
+			luaL_pushresult(&_buffer);
+			lua_error(_lua);
+			std::abort();
+		};
+	};
+};
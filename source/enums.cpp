@@ -0,0 +1,23 @@
+#include <luacpp.hpp>
+
+namespace lua::impl
+{
+	void push_enum_name_cache(state_ptr _lua, void* _key, const std::string_view* _names, size_t _count)
+	{
+		if (rawget(_lua, LUA_REGISTRYINDEX, _key) == type::table)
+		{
+			return;
+		};
+		pop(_lua);
+
+		// Interned once, pushing a name is then a table read instead of hashing the string
+		newtable(_lua, static_cast<int>(_count), 0);
+		for (size_t n = 0; n != _count; ++n)
+		{
+			lua_pushlstring(_lua, _names[n].data(), _names[n].size());
+			lua_rawseti(_lua, -2, static_cast<lua_Integer>(n) + 1);
+		};
+		copy(_lua, -1);
+		rawset(_lua, LUA_REGISTRYINDEX, _key);
+	};
+};
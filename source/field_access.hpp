@@ -0,0 +1,109 @@
+#pragma once
+
+/*
+	Reads and writes of typed fields at a byte address, shared by struct arrays and usertype properties.
+*/
+
+#include <luacpp.hpp>
+
+#include <new>
+#include <limits>
+
+namespace lua::impl
+{
+	template <typename T>
+	inline T load_field(const std::byte* _src)
+	{
+		T _value{};
+		std::memcpy(&_value, _src, sizeof(T));
+		return _value;
+	};
+
+	template <typename T>
+	inline void store_field(std::byte* _dest, T _value)
+	{
+		std::memcpy(_dest, &_value, sizeof(T));
+	};
+
+	template <typename T>
+	inline void store_integer_field(state_ptr _lua, std::byte* _dest, int _valueIndex)
+	{
+		const auto _value = luaL_checkinteger(_lua, _valueIndex);
+		if constexpr (sizeof(T) < sizeof(lua_Integer))
+		{
+			luaL_argcheck(_lua, _value >= static_cast<lua_Integer>(std::numeric_limits<T>::min()) &&
+				_value <= static_cast<lua_Integer>(std::numeric_limits<T>::max()), _valueIndex, "integer overflow");
+		};
+		store_field(_dest, static_cast<T>(_value));
+	};
+
+	inline void store_string_field(state_ptr _lua, std::byte* _dest, int _valueIndex)
+	{
+		size_t _len = 0;
+		const auto _str = luaL_checklstring(_lua, _valueIndex, &_len);
+		bool _failed = false;
+		try
+		{
+			reinterpret_cast<std::string*>(_dest)->assign(_str, _len);
+		}
+		catch (const std::bad_alloc&)
+		{
+			_failed = true;
+		};
+		if (_failed)
+		{
+			luaL_error(_lua, "not enough memory");
+		};
+	};
+
+	/**
+	 * @brief Pushes the value of a field.
+	 * @param _src Address of the field.
+	*/
+	inline void push_field_value(state_ptr _lua, const std::byte* _src, field_kind _kind)
+	{
+		switch (_kind)
+		{
+		case field_kind::boolean: lua_pushboolean(_lua, load_field<bool>(_src)); break;
+		case field_kind::int8: lua_pushinteger(_lua, load_field<int8_t>(_src)); break;
+		case field_kind::uint8: lua_pushinteger(_lua, load_field<uint8_t>(_src)); break;
+		case field_kind::int16: lua_pushinteger(_lua, load_field<int16_t>(_src)); break;
+		case field_kind::uint16: lua_pushinteger(_lua, load_field<uint16_t>(_src)); break;
+		case field_kind::int32: lua_pushinteger(_lua, load_field<int32_t>(_src)); break;
+		case field_kind::uint32: lua_pushinteger(_lua, load_field<uint32_t>(_src)); break;
+		case field_kind::int64: lua_pushinteger(_lua, load_field<int64_t>(_src)); break;
+		case field_kind::uint64: lua_pushinteger(_lua, static_cast<lua_Integer>(load_field<uint64_t>(_src))); break;
+		case field_kind::float32: lua_pushnumber(_lua, load_field<float>(_src)); break;
+		case field_kind::float64: lua_pushnumber(_lua, static_cast<lua_Number>(load_field<double>(_src))); break;
+		case field_kind::string:
+		{
+			const auto& _str = *reinterpret_cast<const std::string*>(_src);
+			lua_pushlstring(_lua, _str.data(), _str.size());
+			break;
+		}
+		};
+	};
+
+	/**
+	 * @brief Stores the value at _valueIndex into a field, raising an error if it does not fit.
+	 * @param _dest Address of the field.
+	*/
+	inline void store_field_value(state_ptr _lua, std::byte* _dest, field_kind _kind, int _valueIndex)
+	{
+		switch (_kind)
+		{
+		case field_kind::boolean: store_field<bool>(_dest, lua_toboolean(_lua, _valueIndex)); break;
+		case field_kind::int8: store_integer_field<int8_t>(_lua, _dest, _valueIndex); break;
+		case field_kind::uint8: store_integer_field<uint8_t>(_lua, _dest, _valueIndex); break;
+		case field_kind::int16: store_integer_field<int16_t>(_lua, _dest, _valueIndex); break;
+		case field_kind::uint16: store_integer_field<uint16_t>(_lua, _dest, _valueIndex); break;
+		case field_kind::int32: store_integer_field<int32_t>(_lua, _dest, _valueIndex); break;
+		case field_kind::uint32: store_integer_field<uint32_t>(_lua, _dest, _valueIndex); break;
+		case field_kind::int64: store_integer_field<int64_t>(_lua, _dest, _valueIndex); break;
+		case field_kind::uint64: store_field(_dest, static_cast<uint64_t>(luaL_checkinteger(_lua, _valueIndex))); break;
+		case field_kind::float32: store_field(_dest, static_cast<float>(luaL_checknumber(_lua, _valueIndex))); break;
+		case field_kind::float64: store_field(_dest, static_cast<double>(luaL_checknumber(_lua, _valueIndex))); break;
+		case field_kind::string: store_string_field(_lua, _dest, _valueIndex); break;
+		};
+	};
+};
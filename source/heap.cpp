@@ -0,0 +1,972 @@
+#include <luacpp.hpp>
+
+#include <new>
+#include <string>
+#include <fstream>
+#include <unordered_map>
+
+#include <cstdio>
+#include <cerrno>
+#include <climits>
+
+namespace lua
+{
+	namespace
+	{
+		constexpr uint32_t no_node = UINT32_MAX;
+
+		/*
+			Approximate lua 5.4 object sizes on the host, lua does not expose the real ones.
+		*/
+		constexpr size_t estimated_value_bytes = 2 * sizeof(void*);
+		constexpr size_t estimated_node_bytes = 3 * sizeof(void*);
+		constexpr size_t estimated_string_header = 3 * sizeof(void*);
+		constexpr size_t estimated_table_header = 7 * sizeof(void*);
+		constexpr size_t estimated_userdata_header = 5 * sizeof(void*);
+		constexpr size_t estimated_closure_header = 4 * sizeof(void*);
+		constexpr size_t estimated_thread_header = 25 * sizeof(void*);
+
+		// Longest string content used as a node or edge name
+		constexpr size_t max_name_length = 64;
+
+		std::string_view truncate_name(std::string_view _name)
+		{
+			return _name.substr(0, max_name_length);
+		};
+	};
+
+	/*
+		Builds a snapshot from inside a protected call. Values to visit are kept in a lua table
+		indexed by node id, strings have no outgoing references and are not stored.
+	*/
+	struct impl::heap_builder
+	{
+		heap_snapshot& snapshot;
+		state_ptr lua;
+		int objects = 0;
+
+		std::unordered_map<const void*, uint32_t> ids{};
+		std::unordered_map<std::string, uint32_t> string_ids{};
+
+		uint32_t intern(std::string_view _str)
+		{
+			const auto [_it, _inserted] = this->string_ids.try_emplace(std::string(_str), static_cast<uint32_t>(this->snapshot.strings_.size()));
+			if (_inserted)
+			{
+				this->snapshot.strings_.emplace_back(_str);
+			};
+			return _it->second;
+		};
+
+		// Reads a string field of the metatable of the value at _index without invoking metamethods
+		std::string_view metafield(int _index, const char* _field)
+		{
+			std::string_view _value{};
+			if (lua_getmetatable(this->lua, _index))
+			{
+				lua_pushstring(this->lua, _field);
+				if (lua_rawget(this->lua, -2) == LUA_TSTRING)
+				{
+					size_t _len = 0;
+					const auto _str = lua_tolstring(this->lua, -1, &_len);
+					_value = std::string_view(_str, _len);
+				};
+				// The string stays alive, it is referenced by the metatable
+				pop(this->lua, 2);
+			};
+			return _value;
+		};
+
+		void describe(heap_snapshot::node& _node, int _index)
+		{
+			auto _className = std::string_view{};
+			auto _name = std::string_view{};
+			std::string _nameStorage{};
+
+			switch (_node.type)
+			{
+			case LUA_TSTRING:
+			{
+				size_t _len = 0;
+				const auto _str = lua_tolstring(this->lua, _index, &_len);
+				_node.self_size = estimated_string_header + _len + 1;
+				_className = "string";
+				_name = truncate_name(std::string_view(_str, _len));
+				break;
+			}
+			case LUA_TTABLE:
+			{
+				const auto _usage = get_table_usage(this->lua, _index);
+				if (_usage.sizes_known)
+				{
+					_node.self_size = estimated_table_header +
+						_usage.array_size * estimated_value_bytes + _usage.hash_size * estimated_node_bytes;
+				}
+				else
+				{
+					_node.self_size = estimated_table_header + _usage.array_count * estimated_value_bytes +
+						((_usage.hash_count != 0) ? std::bit_ceil(_usage.hash_count) * estimated_node_bytes : 0);
+				};
+				_className = this->metafield(_index, "__name");
+				if (_className.empty())
+				{
+					_className = "table";
+				};
+				_name = _className;
+				break;
+			}
+			case LUA_TFUNCTION:
+			{
+				lua_Debug _info{};
+				lua_pushvalue(this->lua, _index);
+				lua_getinfo(this->lua, ">Su", &_info);
+				const bool _isC = _info.what[0] == 'C';
+				_node.self_size = estimated_closure_header + _info.nups * ((_isC) ? estimated_value_bytes : sizeof(void*));
+				_className = "function";
+				if (_isC)
+				{
+					_name = "C function";
+				}
+				else
+				{
+					_nameStorage = "function@" + std::string(_info.short_src) + ":" + std::to_string(_info.linedefined);
+					_name = _nameStorage;
+				};
+				break;
+			}
+			case LUA_TUSERDATA:
+			{
+				_node.self_size = estimated_userdata_header + lua_rawlen(this->lua, _index);
+				for (int n = 1; lua_getiuservalue(this->lua, _index, n) != LUA_TNONE; ++n)
+				{
+					_node.self_size += estimated_value_bytes;
+					pop(this->lua);
+				};
+				pop(this->lua);
+				_className = this->metafield(_index, "__name");
+				if (_className.empty())
+				{
+					_className = "userdata";
+				};
+				_name = _className;
+				break;
+			}
+			case LUA_TTHREAD:
+				_node.self_size = estimated_thread_header + static_cast<size_t>(lua_gettop(lua_tothread(this->lua, _index))) * estimated_value_bytes;
+				_className = "thread";
+				_name = _className;
+				break;
+			default:
+				break;
+			};
+
+			_node.class_name = this->intern(_className);
+			_node.name = this->intern(_name);
+		};
+
+		// Gets or creates the node of the value at _index, no_node for values that are not objects
+		uint32_t node_of(int _index)
+		{
+			const auto _type = lua_type(this->lua, _index);
+			switch (_type)
+			{
+			case LUA_TSTRING: [[fallthrough]];
+			case LUA_TTABLE: [[fallthrough]];
+			case LUA_TFUNCTION: [[fallthrough]];
+			case LUA_TUSERDATA: [[fallthrough]];
+			case LUA_TTHREAD:
+				break;
+			default:
+				return no_node;
+			};
+
+			const auto _address = lua_topointer(this->lua, _index);
+			if (!_address)
+			{
+				return no_node;
+			};
+			if (const auto _it = this->ids.find(_address); _it != this->ids.end())
+			{
+				return _it->second;
+			};
+
+			_index = abs(this->lua, _index);
+			const auto _id = static_cast<uint32_t>(this->snapshot.nodes_.size());
+			this->ids.emplace(_address, _id);
+
+			auto _node = heap_snapshot::node{};
+			_node.address = _address;
+			_node.type = _type;
+			this->describe(_node, _index);
+			this->snapshot.nodes_.push_back(_node);
+
+			if (_type != LUA_TSTRING)
+			{
+				lua_pushvalue(this->lua, _index);
+				lua_rawseti(this->lua, this->objects, static_cast<lua_Integer>(_id));
+			};
+			return _id;
+		};
+
+		// Adds an edge from _from to the value at _index
+		void link(uint32_t _from, heap_snapshot::edge_kind _kind, uint32_t _name, int _index)
+		{
+			const auto _count = this->snapshot.nodes_.size();
+			const auto _to = this->node_of(_index);
+			if (_to == no_node)
+			{
+				return;
+			};
+
+			auto& _edges = this->snapshot.edges_;
+			if (_to >= _count)
+			{
+				this->snapshot.nodes_[_to].parent_edge = static_cast<uint32_t>(_edges.size());
+			};
+			_edges.push_back(heap_snapshot::edge{ _kind, _name, _from, _to });
+			++this->snapshot.nodes_[_from].edge_count;
+		};
+
+		void link(uint32_t _from, heap_snapshot::edge_kind _kind, std::string_view _name, int _index)
+		{
+			this->link(_from, _kind, this->intern(_name), _index);
+		};
+
+		void visit_table(uint32_t _id, int _index)
+		{
+			using kind = heap_snapshot::edge_kind;
+
+			const auto _mode = this->metafield(_index, "__mode");
+			const bool _weakKeys = _mode.find('k') != std::string_view::npos;
+			const bool _weakValues = _mode.find('v') != std::string_view::npos;
+			const auto _keyName = this->intern("[key]");
+			const auto _valueName = this->intern("[value]");
+
+			lua_pushnil(this->lua);
+			while (next(this->lua, _index))
+			{
+				const auto _keyIndex = top(this->lua) - 1;
+				this->link(_id, (_weakKeys) ? kind::weak : kind::internal, _keyName, _keyIndex);
+
+				if (_weakValues)
+				{
+					this->link(_id, kind::weak, _valueName, -1);
+				}
+				else if (lua_type(this->lua, _keyIndex) == LUA_TSTRING)
+				{
+					size_t _len = 0;
+					const auto _key = lua_tolstring(this->lua, _keyIndex, &_len);
+					this->link(_id, kind::property, truncate_name(std::string_view(_key, _len)), -1);
+				}
+				else if (lua_isinteger(this->lua, _keyIndex) && lua_tointeger(this->lua, _keyIndex) >= 0 &&
+					lua_tointeger(this->lua, _keyIndex) <= UINT32_MAX)
+				{
+					this->link(_id, kind::element, static_cast<uint32_t>(lua_tointeger(this->lua, _keyIndex)), -1);
+				}
+				else
+				{
+					this->link(_id, kind::internal, _valueName, -1);
+				};
+				pop(this->lua);
+			};
+
+			if (lua_getmetatable(this->lua, _index))
+			{
+				this->link(_id, kind::internal, "metatable", -1);
+				pop(this->lua);
+			};
+		};
+
+		void visit_function(uint32_t _id, int _index)
+		{
+			for (int n = 1; ; ++n)
+			{
+				const auto _name = lua_getupvalue(this->lua, _index, n);
+				if (!_name)
+				{
+					break;
+				};
+				if (*_name)
+				{
+					this->link(_id, heap_snapshot::edge_kind::context, _name, -1);
+				}
+				else
+				{
+					this->link(_id, heap_snapshot::edge_kind::context, "upvalue " + std::to_string(n), -1);
+				};
+				pop(this->lua);
+			};
+		};
+
+		void visit_userdata(uint32_t _id, int _index)
+		{
+			for (int n = 1; lua_getiuservalue(this->lua, _index, n) != LUA_TNONE; ++n)
+			{
+				this->link(_id, heap_snapshot::edge_kind::internal, "uservalue " + std::to_string(n), -1);
+				pop(this->lua);
+			};
+			pop(this->lua);
+
+			if (lua_getmetatable(this->lua, _index))
+			{
+				this->link(_id, heap_snapshot::edge_kind::internal, "metatable", -1);
+				pop(this->lua);
+			};
+		};
+
+		// Links the locals of the active functions of a thread
+		void visit_locals(uint32_t _id, state_ptr _thread, int _firstLevel)
+		{
+			lua_Debug _info{};
+			for (int _level = _firstLevel; lua_getstack(_thread, _level, &_info); ++_level)
+			{
+				for (int n = 1; ; ++n)
+				{
+					if (!lua_checkstack(_thread, 1))
+					{
+						return;
+					};
+					const auto _name = lua_getlocal(_thread, &_info, n);
+					if (!_name)
+					{
+						break;
+					};
+					if (_thread != this->lua)
+					{
+						lua_xmove(_thread, this->lua, 1);
+					};
+					this->link(_id, heap_snapshot::edge_kind::context, _name, -1);
+					pop(this->lua);
+				};
+			};
+		};
+
+		void visit_thread(uint32_t _id, int _index)
+		{
+			const auto _thread = lua_tothread(this->lua, _index);
+			if (_thread == this->lua)
+			{
+				// The walking thread is visited by the root
+				return;
+			};
+
+			const auto _top = lua_gettop(_thread);
+			for (int n = 1; n <= _top && lua_checkstack(_thread, 1); ++n)
+			{
+				lua_pushvalue(_thread, n);
+				lua_xmove(_thread, this->lua, 1);
+				this->link(_id, heap_snapshot::edge_kind::internal, "stack", -1);
+				pop(this->lua);
+			};
+			this->visit_locals(_id, _thread, 0);
+		};
+
+		/*
+			Walks the heap, called through lua_pcall with the builder as argument 1 followed by the
+			stack of the calling function.
+		*/
+		void walk(int _argCount)
+		{
+			using kind = heap_snapshot::edge_kind;
+
+			luaL_checkstack(this->lua, 8, nullptr);
+			newtable(this->lua);
+			this->objects = top(this->lua);
+
+			auto& _nodes = this->snapshot.nodes_;
+			auto _root = heap_snapshot::node{};
+			_root.name = this->intern("(root)");
+			_root.class_name = _root.name;
+			_nodes.push_back(_root);
+
+			lua_rawgeti(this->lua, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
+			this->link(0, kind::internal, "globals", -1);
+			pop(this->lua);
+			lua_pushvalue(this->lua, LUA_REGISTRYINDEX);
+			this->link(0, kind::internal, "registry", -1);
+			pop(this->lua);
+			for (int n = 2; n <= _argCount; ++n)
+			{
+				this->link(0, kind::internal, "stack", n);
+			};
+			this->visit_locals(0, this->lua, 1);
+
+			for (uint32_t _id = 1; _id < _nodes.size(); ++_id)
+			{
+				_nodes[_id].first_edge = static_cast<uint32_t>(this->snapshot.edges_.size());
+				const auto _type = lua_rawgeti(this->lua, this->objects, static_cast<lua_Integer>(_id));
+				const auto _index = top(this->lua);
+				switch (_type)
+				{
+				case LUA_TTABLE:
+					this->visit_table(_id, _index);
+					break;
+				case LUA_TFUNCTION:
+					this->visit_function(_id, _index);
+					break;
+				case LUA_TUSERDATA:
+					this->visit_userdata(_id, _index);
+					break;
+				case LUA_TTHREAD:
+					this->visit_thread(_id, _index);
+					break;
+				default:
+					break;
+				};
+				pop(this->lua);
+			};
+		};
+
+		/*
+			Immediate dominators (Cooper, Harvey and Kennedy's iterative algorithm) and retained sizes.
+			Weak edges do not keep objects alive and are ignored.
+		*/
+		void compute_retained_sizes()
+		{
+			auto& _nodes = this->snapshot.nodes_;
+			const auto& _edges = this->snapshot.edges_;
+			const auto _count = _nodes.size();
+
+			// Post order of a depth first walk from the root
+			std::vector<uint32_t> _order{};
+			std::vector<uint32_t> _postIndex(_count, no_node);
+			{
+				_order.reserve(_count);
+				std::vector<bool> _visited(_count, false);
+				std::vector<std::pair<uint32_t, uint32_t>> _stack{};
+				_stack.emplace_back(0, 0);
+				_visited[0] = true;
+				while (!_stack.empty())
+				{
+					auto& [_node, _nextEdge] = _stack.back();
+					const auto& _info = _nodes[_node];
+					if (_nextEdge == _info.edge_count)
+					{
+						_postIndex[_node] = static_cast<uint32_t>(_order.size());
+						_order.push_back(_node);
+						_stack.pop_back();
+						continue;
+					};
+
+					const auto& _edge = _edges[_info.first_edge + _nextEdge++];
+					if (_edge.kind != heap_snapshot::edge_kind::weak && !_visited[_edge.to])
+					{
+						_visited[_edge.to] = true;
+						_stack.emplace_back(_edge.to, 0);
+					};
+				};
+			};
+
+			// Predecessors, compressed by target node
+			std::vector<uint32_t> _predStart(_count + 1, 0);
+			for (auto& _edge : _edges)
+			{
+				if (_edge.kind != heap_snapshot::edge_kind::weak)
+				{
+					++_predStart[_edge.to + 1];
+				};
+			};
+			for (size_t n = 0; n != _count; ++n)
+			{
+				_predStart[n + 1] += _predStart[n];
+			};
+			std::vector<uint32_t> _preds(_predStart.back());
+			{
+				auto _fill = _predStart;
+				for (auto& _edge : _edges)
+				{
+					if (_edge.kind != heap_snapshot::edge_kind::weak)
+					{
+						_preds[_fill[_edge.to]++] = _edge.from;
+					};
+				};
+			};
+
+			std::vector<uint32_t> _idom(_count, no_node);
+			_idom[0] = 0;
+			const auto _intersect = [&](uint32_t _lhs, uint32_t _rhs)
+			{
+				while (_lhs != _rhs)
+				{
+					while (_postIndex[_lhs] < _postIndex[_rhs])
+					{
+						_lhs = _idom[_lhs];
+					};
+					while (_postIndex[_rhs] < _postIndex[_lhs])
+					{
+						_rhs = _idom[_rhs];
+					};
+				};
+				return _lhs;
+			};
+
+			for (bool _changed = true; _changed;)
+			{
+				_changed = false;
+				for (auto it = _order.rbegin(); it != _order.rend(); ++it)
+				{
+					const auto _node = *it;
+					if (_node == 0)
+					{
+						continue;
+					};
+
+					auto _newIdom = no_node;
+					for (auto p = _predStart[_node]; p != _predStart[_node + 1]; ++p)
+					{
+						const auto _pred = _preds[p];
+						if (_idom[_pred] == no_node)
+						{
+							continue;
+						};
+						_newIdom = (_newIdom == no_node) ? _pred : _intersect(_pred, _newIdom);
+					};
+					if (_idom[_node] != _newIdom)
+					{
+						_idom[_node] = _newIdom;
+						_changed = true;
+					};
+				};
+			};
+
+			// Dominators finish after the nodes they dominate, accumulate in post order
+			for (size_t n = 0; n != _count; ++n)
+			{
+				_nodes[n].retained_size = _nodes[n].self_size;
+				_nodes[n].dominator = (_idom[n] == no_node) ? 0 : _idom[n];
+			};
+			for (const auto _node : _order)
+			{
+				if (_node != 0)
+				{
+					_nodes[_nodes[_node].dominator].retained_size += _nodes[_node].retained_size;
+				};
+			};
+			for (size_t n = 1; n != _count; ++n)
+			{
+				// Only reachable through weak references
+				if (_postIndex[n] == no_node)
+				{
+					_nodes[0].retained_size += _nodes[n].self_size;
+				};
+			};
+		};
+	};
+
+	namespace
+	{
+		// (builder, stack...)
+		int heap_walk(state_ptr _lua)
+		{
+			auto& _builder = *static_cast<impl::heap_builder*>(lua_touserdata(_lua, 1));
+			bool _outOfMemory = false;
+			try
+			{
+				_builder.walk(lua_gettop(_lua));
+			}
+			catch (const std::bad_alloc&)
+			{
+				_outOfMemory = true;
+			};
+			if (_outOfMemory)
+			{
+				luaL_error(_lua, "not enough memory");
+			};
+			return 0;
+		};
+
+		void append_format(std::string& _out, const char* _format, auto... _args)
+		{
+			char _line[256]{};
+			const auto _len = std::snprintf(_line, sizeof(_line), _format, _args...);
+			_out.append(_line, static_cast<size_t>(std::clamp(_len, 0, static_cast<int>(sizeof(_line) - 1))));
+		};
+
+		void write_json_string(std::ostream& _out, std::string_view _str)
+		{
+			constexpr char _hex[] = "0123456789abcdef";
+			_out.put('"');
+			for (const char c : _str)
+			{
+				const auto _byte = static_cast<unsigned char>(c);
+				if (c == '"' || c == '\\')
+				{
+					_out.put('\\');
+					_out.put(c);
+				}
+				else if (_byte < 0x20 || _byte >= 0x7F)
+				{
+					// Bytes are written as latin-1 code points, lua strings need not be utf-8
+					const char _escape[] = { '\\', 'u', '0', '0', _hex[_byte >> 4], _hex[_byte & 0xF] };
+					_out.write(_escape, sizeof(_escape));
+				}
+				else
+				{
+					_out.put(c);
+				};
+			};
+			_out.put('"');
+		};
+	};
+
+
+
+	std::vector<heap_snapshot::class_stats> heap_snapshot::census() const
+	{
+		std::vector<class_stats> _classes(this->strings_.size());
+		for (size_t n = 1; n < this->nodes_.size(); ++n)
+		{
+			const auto& _node = this->nodes_[n];
+			auto& _class = _classes[_node.class_name];
+			_class.name = this->strings_[_node.class_name];
+			++_class.count;
+			_class.self_size += _node.self_size;
+		};
+		std::erase_if(_classes, [](const class_stats& _class) { return _class.count == 0; });
+		std::ranges::sort(_classes, std::ranges::greater{}, &class_stats::self_size);
+		return _classes;
+	};
+
+	std::string heap_snapshot::path_to(uint32_t _node) const
+	{
+		std::vector<const edge*> _chain{};
+		while (_node != 0 && _node < this->nodes_.size())
+		{
+			const auto& _edge = this->edges_[this->nodes_[_node].parent_edge];
+			_chain.push_back(&_edge);
+			_node = _edge.from;
+		};
+
+		std::string _path{};
+		for (auto it = _chain.rbegin(); it != _chain.rend(); ++it)
+		{
+			const auto& _edge = **it;
+			if (_edge.kind == edge_kind::element)
+			{
+				_path += "[" + std::to_string(_edge.name) + "]";
+				continue;
+			};
+
+			const auto& _name = this->strings_[_edge.name];
+			if (_edge.from == 0)
+			{
+				_path += _name;
+			}
+			else if (_edge.kind == edge_kind::property)
+			{
+				_path += "." + _name;
+			}
+			else
+			{
+				_path += "<" + _name + ">";
+			};
+		};
+		return _path;
+	};
+
+	std::string heap_snapshot::report(size_t _count) const
+	{
+		std::string _out{};
+		append_format(_out, "heap: %zu objects, %zu bytes (estimated)\n\n",
+			(this->nodes_.empty()) ? size_t(0) : this->nodes_.size() - 1, this->total_size());
+
+		append_format(_out, "%-32s %12s %14s\n", "class", "count", "bytes");
+		const auto _classes = this->census();
+		for (size_t n = 0; n != std::min(_count, _classes.size()); ++n)
+		{
+			const auto& _class = _classes[n];
+			const auto _name = std::string(truncate_name(_class.name).substr(0, 32));
+			append_format(_out, "%-32s %12zu %14zu\n", _name.c_str(), _class.count, _class.self_size);
+		};
+
+		std::vector<uint32_t> _largest{};
+		_largest.reserve(this->nodes_.size());
+		for (uint32_t n = 1; n < this->nodes_.size(); ++n)
+		{
+			_largest.push_back(n);
+		};
+		const auto _shown = std::min(_count, _largest.size());
+		std::ranges::partial_sort(_largest, _largest.begin() + _shown, std::ranges::greater{},
+			[this](uint32_t _node) { return this->nodes_[_node].retained_size; });
+
+		append_format(_out, "\n%14s  %-16s %s\n", "retained", "class", "path");
+		for (size_t n = 0; n != _shown; ++n)
+		{
+			const auto& _node = this->nodes_[_largest[n]];
+			const auto _className = std::string(this->strings_[_node.class_name].substr(0, 16));
+			append_format(_out, "%14zu  %-16s ", _node.retained_size, _className.c_str());
+			_out += this->path_to(_largest[n]);
+			_out += '\n';
+		};
+		return _out;
+	};
+
+	bool heap_snapshot::write(const char* _path) const
+	{
+		auto _file = std::ofstream(_path, std::ios::binary);
+		if (!_file)
+		{
+			return false;
+		};
+
+		// Node and edge types of the format, see v8's heap snapshot generator
+		constexpr size_t node_field_count = 6;
+		const auto _nodeType = [](int _type)
+		{
+			switch (_type)
+			{
+			case LUA_TSTRING: return 2;		// string
+			case LUA_TTABLE: return 3;		// object
+			case LUA_TFUNCTION: return 5;	// closure
+			case LUA_TUSERDATA: return 8;	// native
+			case LUA_TTHREAD: return 3;		// object
+			default: return 9;				// synthetic
+			};
+		};
+		const auto _edgeType = [](edge_kind _kind)
+		{
+			switch (_kind)
+			{
+			case edge_kind::context: return 0;
+			case edge_kind::element: return 1;
+			case edge_kind::property: return 2;
+			case edge_kind::weak: return 6;
+			default: return 3;				// internal
+			};
+		};
+
+		_file << R"({"snapshot":{"meta":{)"
+			R"("node_fields":["type","name","id","self_size","edge_count","trace_node_id"],)"
+			R"("node_types":[["hidden","array","string","object","code","closure","regexp","number","native","synthetic","concatenated string","sliced string","symbol","bigint"],"string","number","number","number","number"],)"
+			R"("edge_fields":["type","name_or_index","to_node"],)"
+			R"("edge_types":[["context","element","property","internal","hidden","shortcut","weak"],"string_or_number","node"],)"
+			R"("trace_function_info_fields":[],"trace_node_fields":[],"sample_fields":[],"location_fields":[]},)";
+		_file << R"("node_count":)" << this->nodes_.size() << R"(,"edge_count":)" << this->edges_.size()
+			<< R"(,"trace_function_count":0},)" << '\n';
+
+		_file << R"("nodes":[)";
+		for (size_t n = 0; n != this->nodes_.size(); ++n)
+		{
+			const auto& _node = this->nodes_[n];
+			_file << ((n == 0) ? "" : ",\n") << _nodeType(_node.type) << ',' << _node.name << ',' << (n * 2 + 1)
+				<< ',' << _node.self_size << ',' << _node.edge_count << ",0";
+		};
+		_file << "],\n" << R"("edges":[)";
+		for (size_t n = 0; n != this->edges_.size(); ++n)
+		{
+			const auto& _edge = this->edges_[n];
+			_file << ((n == 0) ? "" : ",\n") << _edgeType(_edge.kind) << ',' << _edge.name << ',' << (_edge.to * node_field_count);
+		};
+		_file << "],\n" << R"("trace_function_infos":[],"trace_tree":[],"samples":[],"locations":[],"strings":[)";
+		for (size_t n = 0; n != this->strings_.size(); ++n)
+		{
+			if (n != 0)
+			{
+				_file << ",\n";
+			};
+			write_json_string(_file, this->strings_[n]);
+		};
+		_file << "]}\n";
+
+		_file.close();
+		return !_file.fail();
+	};
+
+	bool take_heap_snapshot(state_ptr _lua, heap_snapshot& _outSnapshot)
+	{
+		_outSnapshot = heap_snapshot{};
+		auto _builder = impl::heap_builder{ _outSnapshot, _lua };
+
+		// The stack of the caller is passed along so its values are roots
+		const auto _top = top(_lua);
+		if (!lua_checkstack(_lua, _top + 2))
+		{
+			return false;
+		};
+		lua_pushcfunction(_lua, &heap_walk);
+		lua_pushlightuserdata(_lua, &_builder);
+		for (int n = 1; n <= _top; ++n)
+		{
+			lua_pushvalue(_lua, n);
+		};
+		if (lua_pcall(_lua, _top + 1, 0, 0) != LUA_OK)
+		{
+			pop(_lua);
+			_outSnapshot = heap_snapshot{};
+			return false;
+		};
+
+		_builder.compute_retained_sizes();
+		return true;
+	};
+
+	std::vector<heap_diff_entry> diff_heap_snapshots(const heap_snapshot& _before, const heap_snapshot& _after)
+	{
+		std::unordered_map<std::string_view, heap_diff_entry> _classes{};
+		for (auto& _class : _before.census())
+		{
+			auto& _entry = _classes[_class.name];
+			_entry.count -= static_cast<ptrdiff_t>(_class.count);
+			_entry.self_size -= static_cast<ptrdiff_t>(_class.self_size);
+		};
+		for (auto& _class : _after.census())
+		{
+			auto& _entry = _classes[_class.name];
+			_entry.count += static_cast<ptrdiff_t>(_class.count);
+			_entry.self_size += static_cast<ptrdiff_t>(_class.self_size);
+		};
+
+		std::vector<heap_diff_entry> _diff{};
+		for (auto& [_name, _entry] : _classes)
+		{
+			if (_entry.count != 0 || _entry.self_size != 0)
+			{
+				_entry.name = _name;
+				_diff.push_back(std::move(_entry));
+			};
+		};
+		std::ranges::sort(_diff, std::ranges::greater{}, [](const heap_diff_entry& _entry)
+			{
+				return (_entry.self_size < 0) ? -_entry.self_size : _entry.self_size;
+			});
+		return _diff;
+	};
+
+
+
+	namespace
+	{
+		/*
+			"heap.snapshot" userdata : a heap_snapshot.
+		*/
+
+		heap_snapshot& check_snapshot(state_ptr _lua, int _index)
+		{
+			const auto _snapshot = testudata<heap_snapshot>(_lua, _index);
+			if (!_snapshot)
+			{
+				luaL_typeerror(_lua, _index, "heap.snapshot");
+			};
+			return *_snapshot;
+		};
+
+		size_t check_row_count(state_ptr _lua, int _arg)
+		{
+			const auto _count = luaL_optinteger(_lua, _arg, 20);
+			luaL_argcheck(_lua, _count >= 0, _arg, "count must not be negative");
+			return static_cast<size_t>(_count);
+		};
+
+		// Pushes a std::string, released before any error can be raised
+		void push_text(state_ptr _lua, std::string&& _text)
+		{
+			buffer _buffer{};
+			const auto _dest = init(_lua, _buffer, _text.size());
+			std::memcpy(_dest, _text.data(), _text.size());
+			const auto _size = _text.size();
+			std::string{}.swap(_text);
+			push(std::move(_buffer), _size);
+		};
+
+		// (self [, count]) -> string
+		int snapshot_report(state_ptr _lua)
+		{
+			const auto& _snapshot = check_snapshot(_lua, 1);
+			push_text(_lua, _snapshot.report(check_row_count(_lua, 2)));
+			return 1;
+		};
+
+		// (self, path) -> true | fail, message, errno
+		int snapshot_write(state_ptr _lua)
+		{
+			const auto& _snapshot = check_snapshot(_lua, 1);
+			const auto _path = luaL_checkstring(_lua, 2);
+			return luaL_fileresult(_lua, _snapshot.write(_path), _path);
+		};
+
+		// (self) -> bytes, object count
+		int snapshot_size(state_ptr _lua)
+		{
+			const auto& _snapshot = check_snapshot(_lua, 1);
+			lua_pushinteger(_lua, static_cast<lua_Integer>(_snapshot.total_size()));
+			lua_pushinteger(_lua, static_cast<lua_Integer>(std::max<size_t>(_snapshot.nodes().size(), 1) - 1));
+			return 2;
+		};
+
+		int snapshot_gc(state_ptr _lua)
+		{
+			destroy_udata<heap_snapshot>(_lua, 1, "heap.snapshot");
+			return 0;
+		};
+
+		constexpr luaL_Reg snapshot_methods[] =
+		{
+			{ "report", &snapshot_report },
+			{ "write", &snapshot_write },
+			{ "size", &snapshot_size },
+			{ nullptr, nullptr }
+		};
+
+		void init_snapshot_metatable(state_ptr _lua, int _metatableIndex)
+		{
+			luaL_newlib(_lua, snapshot_methods);
+			lua_setfield(_lua, _metatableIndex, "__index");
+			lua_pushcfunction(_lua, &snapshot_gc);
+			lua_setfield(_lua, _metatableIndex, "__gc");
+			lua_pushliteral(_lua, "heap.snapshot");
+			lua_setfield(_lua, _metatableIndex, "__name");
+			lua_pushboolean(_lua, false);
+			lua_setfield(_lua, _metatableIndex, "__metatable");
+		};
+
+		// () -> heap.snapshot
+		int heap_snapshot_new(state_ptr _lua)
+		{
+			auto& _snapshot = *new (newuserdata(_lua, sizeof(heap_snapshot), 0)) heap_snapshot{};
+			get_or_create_metatable<heap_snapshot>(_lua, &init_snapshot_metatable);
+			setmetatable(_lua, -2);
+			if (!take_heap_snapshot(_lua, _snapshot))
+			{
+				luaL_error(_lua, "not enough memory");
+			};
+			return 1;
+		};
+
+		// (before, after [, count]) -> string
+		int heap_diff(state_ptr _lua)
+		{
+			const auto& _before = check_snapshot(_lua, 1);
+			const auto& _after = check_snapshot(_lua, 2);
+			const auto _count = check_row_count(_lua, 3);
+
+			std::string _out{};
+			{
+				const auto _diff = diff_heap_snapshots(_before, _after);
+				append_format(_out, "heap: %+td bytes (estimated)\n\n",
+					static_cast<ptrdiff_t>(_after.total_size()) - static_cast<ptrdiff_t>(_before.total_size()));
+				append_format(_out, "%-32s %12s %14s\n", "class", "count", "bytes");
+				for (size_t n = 0; n != std::min(_count, _diff.size()); ++n)
+				{
+					const auto& _entry = _diff[n];
+					const auto _name = _entry.name.substr(0, 32);
+					append_format(_out, "%-32s %+12td %+14td\n", _name.c_str(), _entry.count, _entry.self_size);
+				};
+			};
+			push_text(_lua, std::move(_out));
+			return 1;
+		};
+
+		constexpr luaL_Reg heap_functions[] =
+		{
+			{ "snapshot", &heap_snapshot_new },
+			{ "diff", &heap_diff },
+			{ nullptr, nullptr }
+		};
+	};
+
+	int open_heap(state_ptr _lua)
+	{
+		luaL_newlib(_lua, heap_functions);
+		return 1;
+	};
+};
@@ -0,0 +1,208 @@
+#include <luacpp.hpp>
+
+#include <numeric>
+
+namespace lua
+{
+	namespace
+	{
+		struct hook_subscriber
+		{
+			hook_function function;
+			void* userdata;
+			int mask;
+			int count;
+
+			// Instructions left before the next count event of this subscriber
+			int remaining;
+		};
+
+		/*
+			Subscribers of a state's hook, a userdata kept in the registry once created so that
+			removing subscribers from within the hook never frees it under the dispatcher.
+		*/
+		struct hook_mux
+		{
+			std::array<hook_subscriber, max_hook_subscribers> subscribers;
+			size_t size;
+			int mask;
+			int count;
+
+			// Subscriber the running dispatch calls next, remove_hook moves it back past removed subscribers
+			size_t next;
+		};
+
+		hook_mux* get_hook_mux(state_ptr _lua)
+		{
+			rawget(_lua, LUA_REGISTRYINDEX, impl::type_key<hook_mux>());
+			const auto _mux = static_cast<hook_mux*>(lua_touserdata(_lua, -1));
+			pop(_lua);
+			return _mux;
+		};
+
+		int event_mask(int _event)
+		{
+			switch (_event)
+			{
+			case LUA_HOOKCALL:
+				[[fallthrough]];
+			case LUA_HOOKTAILCALL:
+				return LUA_MASKCALL;
+			case LUA_HOOKRET:
+				return LUA_MASKRET;
+			case LUA_HOOKLINE:
+				return LUA_MASKLINE;
+			case LUA_HOOKCOUNT:
+				return LUA_MASKCOUNT;
+			default:
+				return 0;
+			};
+		};
+
+		void dispatch_hook(state_ptr _lua, lua_Debug* _info)
+		{
+			/*
+				Threads copy the hook of the thread creating them and keep it, bring this one up to date
+				with the subscriptions, which removes the hook once there are none.
+			*/
+			const auto _mux = get_hook_mux(_lua);
+			if (!_mux || _mux->size == 0)
+			{
+				lua_sethook(_lua, nullptr, 0, 0);
+				return;
+			};
+			if (lua_gethookmask(_lua) != _mux->mask || lua_gethookcount(_lua) != _mux->count)
+			{
+				lua_sethook(_lua, &dispatch_hook, _mux->mask, _mux->count);
+			};
+
+			// Hooks of other threads may run from within a subscriber, resume their caller's position afterwards
+			const auto _outer = _mux->next;
+			const auto _mask = event_mask(_info->event);
+			for (_mux->next = 0; _mux->next < _mux->size;)
+			{
+				auto& _subscriber = _mux->subscribers[_mux->next++];
+				if ((_subscriber.mask & _mask) == 0)
+				{
+					continue;
+				};
+				if (_mask == LUA_MASKCOUNT)
+				{
+					_subscriber.remaining -= _mux->count;
+					if (_subscriber.remaining > 0)
+					{
+						continue;
+					};
+					_subscriber.remaining = _subscriber.count;
+				};
+				_subscriber.function(_lua, _info, _subscriber.userdata);
+			};
+			_mux->next = _outer;
+		};
+
+		// Installs the union of the subscriptions, or removes the hook when there are none
+		void update_hook(state_ptr _lua, hook_mux& _mux)
+		{
+			int _mask = 0;
+			int _count = 0;
+			for (size_t n = 0; n != _mux.size; ++n)
+			{
+				const auto& _subscriber = _mux.subscribers[n];
+				_mask |= _subscriber.mask;
+				if (_subscriber.mask & LUA_MASKCOUNT)
+				{
+					_count = std::gcd(_count, _subscriber.count);
+				};
+			};
+			_mux.mask = _mask;
+			_mux.count = _count;
+
+			const auto _hook = (_mask == 0) ? lua_Hook{} : &dispatch_hook;
+			lua_rawgeti(_lua, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+			const auto _main = lua_tothread(_lua, -1);
+			pop(_lua);
+			lua_sethook(_main, _hook, _mask, _count);
+			if (_lua != _main)
+			{
+				lua_sethook(_lua, _hook, _mask, _count);
+			};
+		};
+	};
+
+	bool add_hook(state_ptr _lua, hook_function _function, void* _userdata, int _mask, int _count)
+	{
+		assert(_function);
+		if (_count <= 0)
+		{
+			_mask &= ~LUA_MASKCOUNT;
+			_count = 0;
+		};
+		if (_mask == 0)
+		{
+			return false;
+		};
+
+		auto _mux = get_hook_mux(_lua);
+		if (!_mux)
+		{
+			_mux = new (newuserdata(_lua, sizeof(hook_mux), 0)) hook_mux{};
+			rawset(_lua, LUA_REGISTRYINDEX, impl::type_key<hook_mux>());
+		};
+
+		const auto _begin = _mux->subscribers.begin();
+		const auto _end = _begin + _mux->size;
+		const auto _found = std::find_if(_begin, _end, [_function, _userdata](const hook_subscriber& _subscriber)
+		{
+			return _subscriber.function == _function && _subscriber.userdata == _userdata;
+		});
+		if (_found != _end || _mux->size == max_hook_subscribers)
+		{
+			return false;
+		};
+
+		_mux->subscribers[_mux->size++] = hook_subscriber{ _function, _userdata, _mask, _count, _count };
+		update_hook(_lua, *_mux);
+		return true;
+	};
+
+	bool remove_hook(state_ptr _lua, hook_function _function, void* _userdata)
+	{
+		const auto _mux = get_hook_mux(_lua);
+		if (!_mux)
+		{
+			return false;
+		};
+
+		const auto _begin = _mux->subscribers.begin();
+		const auto _end = _begin + _mux->size;
+		const auto _found = std::find_if(_begin, _end, [_function, _userdata](const hook_subscriber& _subscriber)
+		{
+			return _subscriber.function == _function && _subscriber.userdata == _userdata;
+		});
+		if (_found == _end)
+		{
+			return false;
+		};
+
+		// Shifts the following subscribers down to keep the dispatch order
+		if (static_cast<size_t>(_found - _begin) < _mux->next)
+		{
+			--_mux->next;
+		};
+		std::move(_found + 1, _end, _found);
+		--_mux->size;
+		update_hook(_lua, *_mux);
+		return true;
+	};
+
+	void sync_hook(state_ptr _thread)
+	{
+		const auto _mux = get_hook_mux(_thread);
+		if (!_mux || _mux->size == 0)
+		{
+			lua_sethook(_thread, nullptr, 0, 0);
+			return;
+		};
+		lua_sethook(_thread, &dispatch_hook, _mux->mask, _mux->count);
+	};
+};
@@ -0,0 +1,319 @@
+#include <luacpp.hpp>
+
+#include "field_access.hpp"
+
+namespace lua
+{
+	namespace
+	{
+		/*
+			"struct array" userdata : a struct_array, user value 1 is the field table of its layout.
+			"struct element" userdata : a struct_element, user value 1 anchors the array and user value 2
+			is the field table.
+
+			Field tables map field names to 1-based indices into the layout's fields, there is one per
+			layout and state, cached in the registry under the layout's address.
+		*/
+
+		struct struct_array : public impl::view_base
+		{
+			const struct_layout* layout;
+			std::byte* data;
+			size_t count;
+			bool readonly;
+		};
+
+		struct struct_element
+		{
+			const struct_array* array;
+			size_t index;	// 0-based
+		};
+
+		static_assert(std::is_trivially_destructible_v<struct_element>);
+
+		const struct_array& check_live(state_ptr _lua, const struct_array& _array)
+		{
+			if (_array.expired())
+			{
+				luaL_error(_lua, "attempt to access an expired view");
+			};
+			return _array;
+		};
+
+		const struct_array& check_array(state_ptr _lua, int _index)
+		{
+			const auto _array = testudata<struct_array>(_lua, _index);
+			if (!_array)
+			{
+				luaL_typeerror(_lua, _index, "struct array");
+			};
+			return check_live(_lua, *_array);
+		};
+
+		const struct_element& check_element(state_ptr _lua, int _index)
+		{
+			const auto _element = testudata<struct_element>(_lua, _index);
+			if (!_element)
+			{
+				luaL_typeerror(_lua, _index, "struct element");
+			};
+			check_live(_lua, *_element->array);
+			return *_element;
+		};
+
+		std::byte* check_element_data(state_ptr _lua, const struct_array& _array, int _arg)
+		{
+			const auto _index = luaL_checkinteger(_lua, _arg);
+			luaL_argcheck(_lua, _index >= 1 && static_cast<lua_Unsigned>(_index) <= _array.count, _arg, "index out of range");
+			return _array.data + (static_cast<size_t>(_index) - 1) * _array.layout->size();
+		};
+
+		/*
+			Looks up the field named by the value at _keyIndex using the field table at _fieldsIndex.
+			Returns nullptr for unknown fields.
+		*/
+		const struct_layout::field_info* find_field(state_ptr _lua, const struct_array& _array, int _fieldsIndex, int _keyIndex)
+		{
+			lua_pushvalue(_lua, _keyIndex);
+			const auto _fieldNumber = (lua_rawget(_lua, _fieldsIndex) == LUA_TNUMBER) ? lua_tointeger(_lua, -1) : 0;
+			lua_pop(_lua, 1);
+			return (_fieldNumber > 0) ? &_array.layout->fields()[static_cast<size_t>(_fieldNumber - 1)] : nullptr;
+		};
+
+		const struct_layout::field_info& check_field(state_ptr _lua, const struct_array& _array, int _fieldsIndex, int _keyIndex)
+		{
+			const auto _field = find_field(_lua, _array, _fieldsIndex, _keyIndex);
+			if (!_field)
+			{
+				const auto _layoutName = _array.layout->name();
+				lua_pushlstring(_lua, _layoutName.data(), _layoutName.size());
+				const auto _key = luaL_tolstring(_lua, _keyIndex, nullptr);
+				luaL_error(_lua, "no field '%s' in '%s'", _key, lua_tostring(_lua, -2));
+			};
+			return *_field;
+		};
+
+		void push_field(state_ptr _lua, const std::byte* _element, const struct_layout::field_info& _field)
+		{
+			impl::push_field_value(_lua, _element + _field.offset, _field.kind);
+		};
+
+		void set_field(state_ptr _lua, const struct_array& _array, std::byte* _element, const struct_layout::field_info& _field, int _valueIndex)
+		{
+			if (_array.readonly)
+			{
+				luaL_error(_lua, "attempt to modify a read-only view");
+			};
+			if (_field.readonly)
+			{
+				lua_pushlstring(_lua, _field.name.data(), _field.name.size());
+				luaL_error(_lua, "field '%s' is read-only", lua_tostring(_lua, -1));
+			};
+
+			impl::store_field_value(_lua, _element + _field.offset, _field.kind, _valueIndex);
+		};
+
+
+
+		// (element, key) -> value | nil
+		int element_index(state_ptr _lua)
+		{
+			const auto& _element = check_element(_lua, 1);
+			const auto& _array = *_element.array;
+			lua_getiuservalue(_lua, 1, 2);
+			const auto _field = find_field(_lua, _array, 3, 2);
+			if (!_field)
+			{
+				lua_pushnil(_lua);
+				return 1;
+			};
+			push_field(_lua, _array.data + _element.index * _array.layout->size(), *_field);
+			return 1;
+		};
+
+		// (element, key, value)
+		int element_newindex(state_ptr _lua)
+		{
+			const auto& _element = check_element(_lua, 1);
+			const auto& _array = *_element.array;
+			lua_getiuservalue(_lua, 1, 2);
+			const auto& _field = check_field(_lua, _array, 4, 2);
+			set_field(_lua, _array, _array.data + _element.index * _array.layout->size(), _field, 3);
+			return 0;
+		};
+
+		// Elements are equal when they refer to the same struct
+		int element_eq(state_ptr _lua)
+		{
+			const auto _lhs = testudata<struct_element>(_lua, 1);
+			const auto _rhs = testudata<struct_element>(_lua, 2);
+			lua_pushboolean(_lua, _lhs && _rhs &&
+				_lhs->array->data + _lhs->index * _lhs->array->layout->size() ==
+				_rhs->array->data + _rhs->index * _rhs->array->layout->size());
+			return 1;
+		};
+
+		int element_tostring(state_ptr _lua)
+		{
+			const auto& _element = *testudata<struct_element>(_lua, 1);
+			const auto _name = _element.array->layout->name();
+			lua_pushlstring(_lua, _name.data(), _name.size());
+			lua_pushfstring(_lua, "%s[%I]", lua_tostring(_lua, -1), static_cast<lua_Integer>(_element.index + 1));
+			return 1;
+		};
+
+		void init_element_metatable(state_ptr _lua, int _metatableIndex)
+		{
+			lua_pushcfunction(_lua, &element_index);
+			lua_setfield(_lua, _metatableIndex, "__index");
+			lua_pushcfunction(_lua, &element_newindex);
+			lua_setfield(_lua, _metatableIndex, "__newindex");
+			lua_pushcfunction(_lua, &element_eq);
+			lua_setfield(_lua, _metatableIndex, "__eq");
+			lua_pushcfunction(_lua, &element_tostring);
+			lua_setfield(_lua, _metatableIndex, "__tostring");
+			lua_pushliteral(_lua, "struct element");
+			lua_setfield(_lua, _metatableIndex, "__name");
+			lua_pushboolean(_lua, false);
+			lua_setfield(_lua, _metatableIndex, "__metatable");
+		};
+
+
+
+		// (self, index, field) -> value
+		int array_get(state_ptr _lua)
+		{
+			const auto& _array = check_array(_lua, 1);
+			const auto _element = check_element_data(_lua, _array, 2);
+			lua_getiuservalue(_lua, 1, 1);
+			push_field(_lua, _element, check_field(_lua, _array, lua_gettop(_lua), 3));
+			return 1;
+		};
+
+		// (self, index, field, value)
+		int array_set(state_ptr _lua)
+		{
+			const auto& _array = check_array(_lua, 1);
+			const auto _element = check_element_data(_lua, _array, 2);
+			luaL_checkany(_lua, 4);
+			lua_settop(_lua, 4);
+			lua_getiuservalue(_lua, 1, 1);
+			set_field(_lua, _array, _element, check_field(_lua, _array, 5, 3), 4);
+			return 0;
+		};
+
+		constexpr luaL_Reg array_methods[] =
+		{
+			{ "get", &array_get },
+			{ "set", &array_set },
+			{ nullptr, nullptr }
+		};
+
+		// (self, key) -> element | method | nil, upvalue 1 is the methods table
+		int array_index(state_ptr _lua)
+		{
+			const auto& _array = check_array(_lua, 1);
+
+			int _isInteger = 0;
+			const auto _index = lua_tointegerx(_lua, 2, &_isInteger);
+			if (!_isInteger)
+			{
+				lua_pushvalue(_lua, 2);
+				lua_rawget(_lua, lua_upvalueindex(1));
+				return 1;
+			};
+			if (_index < 1 || static_cast<lua_Unsigned>(_index) > _array.count)
+			{
+				lua_pushnil(_lua);
+				return 1;
+			};
+
+			new (newuserdata(_lua, sizeof(struct_element), 2)) struct_element{ &_array, static_cast<size_t>(_index) - 1 };
+			get_or_create_metatable<struct_element>(_lua, &init_element_metatable);
+			setmetatable(_lua, -2);
+			lua_pushvalue(_lua, 1);
+			lua_setiuservalue(_lua, -2, 1);
+			lua_getiuservalue(_lua, 1, 1);
+			lua_setiuservalue(_lua, -2, 2);
+			return 1;
+		};
+
+		int array_newindex(state_ptr _lua)
+		{
+			return luaL_error(_lua, "cannot assign struct array elements, assign their fields instead");
+		};
+
+		int array_len(state_ptr _lua)
+		{
+			lua_pushinteger(_lua, static_cast<lua_Integer>(check_array(_lua, 1).count));
+			return 1;
+		};
+
+		int array_gc(state_ptr _lua)
+		{
+			destroy_udata<struct_array>(_lua, 1, "struct array");
+			return 0;
+		};
+
+		void init_array_metatable(state_ptr _lua, int _metatableIndex)
+		{
+			luaL_newlib(_lua, array_methods);
+			lua_pushcclosure(_lua, &array_index, 1);
+			lua_setfield(_lua, _metatableIndex, "__index");
+			lua_pushcfunction(_lua, &array_newindex);
+			lua_setfield(_lua, _metatableIndex, "__newindex");
+			lua_pushcfunction(_lua, &array_len);
+			lua_setfield(_lua, _metatableIndex, "__len");
+			lua_pushcfunction(_lua, &array_gc);
+			lua_setfield(_lua, _metatableIndex, "__gc");
+			lua_pushliteral(_lua, "struct array");
+			lua_setfield(_lua, _metatableIndex, "__name");
+			lua_pushboolean(_lua, false);
+			lua_setfield(_lua, _metatableIndex, "__metatable");
+		};
+
+		// Pushes the field table of a layout, creating it on first use
+		void push_field_table(state_ptr _lua, const struct_layout& _layout)
+		{
+			if (rawget(_lua, LUA_REGISTRYINDEX, const_cast<struct_layout*>(&_layout)) == type::table)
+			{
+				return;
+			};
+			lua_pop(_lua, 1);
+
+			const auto _fields = _layout.fields();
+			lua_createtable(_lua, 0, static_cast<int>(_fields.size()));
+			for (size_t n = 0; n != _fields.size(); ++n)
+			{
+				lua_pushlstring(_lua, _fields[n].name.data(), _fields[n].name.size());
+				lua_pushinteger(_lua, static_cast<lua_Integer>(n + 1));
+				lua_rawset(_lua, -3);
+			};
+			lua_pushvalue(_lua, -1);
+			rawset(_lua, LUA_REGISTRYINDEX, const_cast<struct_layout*>(&_layout));
+		};
+	};
+
+	namespace impl
+	{
+		void push_struct_array(state_ptr _lua, const struct_layout& _layout, void* _data, size_t _count,
+			bool _readonly, const view_lifetime* _lifetime)
+		{
+			auto _array = new (newuserdata(_lua, sizeof(struct_array), 1)) struct_array{};
+			_array->layout = &_layout;
+			_array->data = static_cast<std::byte*>(_data);
+			_array->count = _count;
+			_array->readonly = _readonly;
+			if (_lifetime)
+			{
+				_array->token = _lifetime->token();
+				_array->tracked = true;
+			};
+
+			get_or_create_metatable<struct_array>(_lua, &init_array_metatable);
+			setmetatable(_lua, -2);
+			push_field_table(_lua, _layout);
+			lua_setiuservalue(_lua, -2, 1);
+		};
+	};
+};
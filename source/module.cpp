@@ -0,0 +1,80 @@
+#include <luacpp.hpp>
+
+namespace lua
+{
+	namespace
+	{
+		/*
+			__index of modules with lazy submodules, (module, key) -> value. The first upvalue maps
+			submodule names to their opening function, the opened submodule is stored in the module.
+		*/
+		int lazy_module_index(state_ptr _lua)
+		{
+			copy(_lua, 2);
+			if (lua_rawget(_lua, lua_upvalueindex(1)) != LUA_TFUNCTION)
+			{
+				return 1;
+			};
+
+			copy(_lua, 2);
+			lua_call(_lua, 1, 1);
+			copy(_lua, 2);
+			copy(_lua, -2);
+			lua_rawset(_lua, 1);
+			return 1;
+		};
+	};
+
+	namespace impl
+	{
+		void push_module(state_ptr _lua, const luaL_Reg* _registry, size_t _count, std::span<const module_submodule> _submodules, int _nup)
+		{
+			luaL_checkstack(_lua, 4, "too many upvalues");
+
+			size_t _eager = 0;
+			for (const auto& _submodule : _submodules)
+			{
+				_eager += (_submodule.lazy) ? 0 : 1;
+			};
+			newtable(_lua, 0, static_cast<int>(_count + _eager));
+			lua_insert(_lua, -(_nup + 1));
+			luaL_setfuncs(_lua, _registry, _nup);
+
+			if (_submodules.empty())
+			{
+				return;
+			};
+
+			const auto _module = top(_lua);
+			newtable(_lua, 0, static_cast<int>(_submodules.size() - _eager));
+			const auto _lazy = top(_lua);
+			for (const auto& _submodule : _submodules)
+			{
+				if (_submodule.lazy)
+				{
+					lua_pushcfunction(_lua, _submodule.open);
+					lua_setfield(_lua, _lazy, _submodule.name);
+				}
+				else
+				{
+					lua_pushcfunction(_lua, _submodule.open);
+					lua_pushstring(_lua, _submodule.name);
+					lua_call(_lua, 1, 1);
+					lua_setfield(_lua, _module, _submodule.name);
+				};
+			};
+
+			if (_eager == _submodules.size())
+			{
+				pop(_lua);
+				return;
+			};
+
+			newtable(_lua, 0, 1);
+			lua_insert(_lua, _lazy);
+			lua_pushcclosure(_lua, &lazy_module_index, 1);
+			lua_setfield(_lua, -2, "__index");
+			lua_setmetatable(_lua, _module);
+		};
+	};
+};
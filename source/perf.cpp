@@ -0,0 +1,375 @@
+#include <luacpp.hpp>
+
+#include <atomic>
+#include <cstdio>
+
+/*
+	perf_event_open is linux only, define LUA_CPP_PERF_EVENTS to 0 or 1 to override the detection.
+*/
+#ifndef LUA_CPP_PERF_EVENTS
+	#if defined(__linux__) && __has_include(<linux/perf_event.h>)
+		#define LUA_CPP_PERF_EVENTS 1
+	#else
+		#define LUA_CPP_PERF_EVENTS 0
+	#endif
+#endif
+
+#if LUA_CPP_PERF_EVENTS
+	#include <linux/perf_event.h>
+	#include <sys/syscall.h>
+	#include <sys/mman.h>
+	#include <unistd.h>
+#endif
+
+namespace lua
+{
+	namespace
+	{
+#if LUA_CPP_PERF_EVENTS
+		struct perf_event_config
+		{
+			uint32_t type;
+			uint64_t config;
+		};
+
+		// Indexed by perf_counter
+		constexpr auto perf_event_configs = std::array
+		{
+			perf_event_config{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+			perf_event_config{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+			perf_event_config{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+			perf_event_config{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+			perf_event_config{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+		};
+		static_assert(perf_event_configs.size() == perf_counter_count);
+
+		int open_perf_event(const perf_event_config& _config)
+		{
+			auto _attr = perf_event_attr{};
+			_attr.size = sizeof(_attr);
+			_attr.type = _config.type;
+			_attr.config = _config.config;
+			_attr.exclude_kernel = 1;
+			_attr.exclude_hv = 1;
+			return static_cast<int>(::syscall(SYS_perf_event_open, &_attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+		};
+
+		// Checks if the counter's mapped page allows reading it with rdpmc
+		bool can_rdpmc(const void* _page) noexcept
+		{
+#if defined(__x86_64__)
+			if (!_page)
+			{
+				return false;
+			};
+			const auto _header = static_cast<const volatile perf_event_mmap_page*>(_page);
+			return _header->cap_user_rdpmc && _header->index != 0;
+#else
+			(void)_page;
+			return false;
+#endif
+		};
+
+#if defined(__x86_64__)
+		uint64_t rdpmc(uint32_t _counter) noexcept
+		{
+			uint32_t _low = 0;
+			uint32_t _high = 0;
+			asm volatile("rdpmc" : "=a"(_low), "=d"(_high) : "c"(_counter));
+			return (static_cast<uint64_t>(_high) << 32) | _low;
+		};
+
+		/*
+			Reads a counter through its mapped page, following the sequence lock protocol
+			documented in linux/perf_event.h. Returns false if rdpmc cannot be used.
+		*/
+		bool read_rdpmc(const void* _page, uint64_t& _value) noexcept
+		{
+			const auto _header = static_cast<const volatile perf_event_mmap_page*>(_page);
+			uint32_t _sequence = 0;
+			uint64_t _count = 0;
+			do
+			{
+				_sequence = _header->lock;
+				std::atomic_signal_fence(std::memory_order_seq_cst);
+
+				const auto _index = _header->index;
+				if (!_header->cap_user_rdpmc || _index == 0)
+				{
+					return false;
+				};
+				const auto _width = _header->pmc_width;
+				auto _raw = static_cast<int64_t>(rdpmc(_index - 1));
+				_raw <<= (64 - _width);
+				_raw >>= (64 - _width);
+				_count = static_cast<uint64_t>(_header->offset + _raw);
+
+				std::atomic_signal_fence(std::memory_order_seq_cst);
+			}
+			while (_header->lock != _sequence);
+
+			_value = _count;
+			return true;
+		};
+#endif
+#endif
+
+		void append_row(std::string& _out, const perf_profiler::entry& _entry)
+		{
+			const auto& _s = _entry.inclusive;
+			const auto _instructions = _s[perf_counter::instructions];
+			const auto _rate = [_instructions](uint64_t _misses)
+			{
+				return (_instructions == 0) ? 0.0 : 1000.0 * static_cast<double>(_misses) / static_cast<double>(_instructions);
+			};
+
+			char _line[256]{};
+			std::snprintf(_line, sizeof(_line), "%10llu %14llu %14llu %14llu %6.2f %8.2f %8.2f  ",
+				static_cast<unsigned long long>(_entry.calls),
+				static_cast<unsigned long long>(_s[perf_counter::task_clock]),
+				static_cast<unsigned long long>(_s[perf_counter::cycles]),
+				static_cast<unsigned long long>(_entry.self[perf_counter::cycles]),
+				_s.ipc(), _rate(_s[perf_counter::cache_misses]), _rate(_s[perf_counter::branch_misses]));
+			_out.append(_line);
+			_out.append(_entry.name);
+			_out.push_back('\n');
+		};
+	};
+
+
+
+	perf_counters::perf_counters()
+	{
+		this->fds_.fill(-1);
+#if LUA_CPP_PERF_EVENTS
+		const auto _pageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+		for (size_t n = 0; n != perf_counter_count; ++n)
+		{
+			const auto _fd = open_perf_event(perf_event_configs[n]);
+			if (_fd == -1)
+			{
+				continue;
+			};
+			this->fds_[n] = _fd;
+
+			// The first page exposes the counter index for rdpmc, reading falls back to read(2) without it
+			if (perf_event_configs[n].type == PERF_TYPE_HARDWARE)
+			{
+				const auto _page = ::mmap(nullptr, _pageSize, PROT_READ, MAP_SHARED, _fd, 0);
+				if (_page != MAP_FAILED)
+				{
+					this->pages_[n] = _page;
+				};
+			};
+		};
+#endif
+	};
+	perf_counters::~perf_counters()
+	{
+#if LUA_CPP_PERF_EVENTS
+		const auto _pageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+		for (size_t n = 0; n != perf_counter_count; ++n)
+		{
+			if (this->pages_[n])
+			{
+				::munmap(this->pages_[n], _pageSize);
+			};
+			if (this->fds_[n] != -1)
+			{
+				::close(this->fds_[n]);
+			};
+		};
+#endif
+	};
+
+	bool perf_counters::available() const noexcept
+	{
+		return std::ranges::any_of(this->fds_, [](int _fd) { return _fd != -1; });
+	};
+
+	bool perf_counters::uses_rdpmc(perf_counter _counter) const noexcept
+	{
+#if LUA_CPP_PERF_EVENTS
+		return can_rdpmc(this->pages_[static_cast<size_t>(_counter)]);
+#else
+		(void)_counter;
+		return false;
+#endif
+	};
+
+	perf_sample perf_counters::read() const noexcept
+	{
+		auto _sample = perf_sample{};
+#if LUA_CPP_PERF_EVENTS
+		for (size_t n = 0; n != perf_counter_count; ++n)
+		{
+			if (this->fds_[n] == -1)
+			{
+				continue;
+			};
+#if defined(__x86_64__)
+			if (this->pages_[n] && read_rdpmc(this->pages_[n], _sample.values[n]))
+			{
+				continue;
+			};
+#endif
+			uint64_t _value = 0;
+			if (::read(this->fds_[n], &_value, sizeof(_value)) == sizeof(_value))
+			{
+				_sample.values[n] = _value;
+			};
+		};
+#endif
+		return _sample;
+	};
+
+
+
+	void perf_profiler::install(state_ptr _lua)
+	{
+		add_hook(_lua, &perf_profiler::hook, this, LUA_MASKCALL | LUA_MASKRET);
+	};
+	void perf_profiler::uninstall(state_ptr _lua)
+	{
+		remove_hook(_lua, &perf_profiler::hook, this);
+		this->stacks_.clear();
+	};
+
+	void perf_profiler::enter(std::vector<frame>& _stack, entry& _target, const void* _function)
+	{
+		++_target.calls;
+		_stack.push_back(frame{ &_target, _function, this->counters_.read(), perf_sample{} });
+	};
+	void perf_profiler::leave(std::vector<frame>& _stack, const perf_sample& _now)
+	{
+		const auto _frame = _stack.back();
+		_stack.pop_back();
+
+		const auto _elapsed = _now - _frame.start;
+		_frame.target->inclusive += _elapsed;
+		_frame.target->self += _elapsed - _frame.children;
+		if (!_stack.empty())
+		{
+			_stack.back().children += _elapsed;
+		};
+	};
+
+	void perf_profiler::hook(state_ptr _lua, lua_Debug* _info, void* _userdata)
+	{
+		auto& _profiler = *static_cast<perf_profiler*>(_userdata);
+
+		// Counters are read first so the bookkeeping below is not attributed to the function
+		const auto _now = _profiler.counters_.read();
+
+		lua_getinfo(_lua, "Sf", _info);
+		const auto _function = lua_topointer(_lua, -1);
+		const auto _key = (*_info->what == 'C') ?
+			function_key{ reinterpret_cast<const void*>(lua_tocfunction(_lua, -1)), -1 } :
+			function_key{ _info->source, _info->linedefined };
+		pop(_lua);
+
+		// Profiling is best effort, running out of memory drops the event instead of raising an error
+		try
+		{
+			_profiler.dispatch(_lua, _info, _key, _function, _now);
+		}
+		catch (const std::bad_alloc&)
+		{
+		};
+	};
+
+	void perf_profiler::dispatch(state_ptr _lua, lua_Debug* _info, const function_key& _key, const void* _function, const perf_sample& _now)
+	{
+		auto& _stack = this->stacks_[_lua];
+		if (_info->event == LUA_HOOKRET)
+		{
+			// Frames unwound by errors never see their return, drop them when their caller returns
+			const auto _found = std::ranges::find(_stack.rbegin(), _stack.rend(), _function, &frame::function);
+			if (_found == _stack.rend())
+			{
+				return;
+			};
+			while (_stack.back().function != _function)
+			{
+				this->leave(_stack, _now);
+			};
+			this->leave(_stack, _now);
+			return;
+		};
+
+		// A tail call replaces the running frame, it will not return on its own
+		if (_info->event == LUA_HOOKTAILCALL && !_stack.empty())
+		{
+			this->leave(_stack, _now);
+		};
+
+		auto [_it, _inserted] = this->functions_.try_emplace(_key);
+		if (_inserted)
+		{
+			lua_getinfo(_lua, "n", _info);
+			const auto _name = (_info->name) ? _info->name : ((*_info->what == 'm') ? "main chunk" : "?");
+			_it->second.name = (*_info->what == 'C') ?
+				std::string(_name) + " [C]" :
+				std::string(_name) + " (" + _info->short_src + ":" + std::to_string(_info->linedefined) + ")";
+		};
+		this->enter(_stack, _it->second, _function);
+	};
+
+	std::vector<perf_profiler::entry> perf_profiler::entries() const
+	{
+		auto _entries = std::vector<entry>{};
+		_entries.reserve(this->functions_.size() + this->scopes_.size());
+		for (const auto& [_key, _entry] : this->functions_)
+		{
+			_entries.push_back(_entry);
+		};
+		for (const auto& [_name, _entry] : this->scopes_)
+		{
+			_entries.push_back(_entry);
+		};
+
+		const auto _counter = (this->counters_.available(perf_counter::cycles)) ? perf_counter::cycles : perf_counter::task_clock;
+		std::ranges::sort(_entries, std::ranges::greater{}, [_counter](const entry& _entry) { return _entry.inclusive[_counter]; });
+		return _entries;
+	};
+
+	std::string perf_profiler::report(size_t _limit) const
+	{
+		auto _out = std::string("     calls  task clock ns    cycles incl    cycles self    IPC  miss/ki  brmiss/ki\n");
+		const auto _entries = this->entries();
+		for (size_t n = 0; n != std::min(_limit, _entries.size()); ++n)
+		{
+			append_row(_out, _entries[n]);
+		};
+		return _out;
+	};
+
+	void perf_profiler::reset()
+	{
+		this->functions_.clear();
+		this->scopes_.clear();
+		this->stacks_.clear();
+		this->scope_stack_.clear();
+	};
+
+
+
+	perf_scope::perf_scope(perf_profiler& _profiler, std::string_view _name) :
+		profiler_(&_profiler)
+	{
+		auto [_it, _inserted] = _profiler.scopes_.try_emplace(std::string(_name));
+		if (_inserted)
+		{
+			_it->second.name = _name;
+		};
+		_profiler.enter(_profiler.scope_stack_, _it->second, nullptr);
+	};
+	perf_scope::~perf_scope()
+	{
+		auto& _profiler = *this->profiler_;
+		if (!_profiler.scope_stack_.empty())
+		{
+			_profiler.leave(_profiler.scope_stack_, _profiler.counters_.read());
+		};
+	};
+};
@@ -0,0 +1,266 @@
+#include <luacpp.hpp>
+
+#include <climits>
+
+namespace lua
+{
+	namespace
+	{
+		/*
+			Approximate sizes of lua 5.4's TValue and Node on the host, used to estimate the cost of
+			entries stored in the wrong part when the internals are not available.
+		*/
+		constexpr size_t estimated_value_bytes = 2 * sizeof(void*);
+		constexpr size_t estimated_node_bytes = 3 * sizeof(void*);
+
+		// Tables of at least this many slots are reported as oversized when less than a quarter is used
+		constexpr size_t min_oversized_slots = 64;
+
+		bool is_traversable(int _type)
+		{
+			return _type == LUA_TTABLE || _type == LUA_TFUNCTION || _type == LUA_TUSERDATA;
+		};
+
+		/*
+			Breadth first walk state, all of it lives on the lua stack so errors leak nothing :
+				seen	: set of visited values
+				queue	: values to visit, in order
+				paths	: path of each queued value
+		*/
+		struct walk
+		{
+			state_ptr lua;
+			int seen;
+			int queue;
+			int paths;
+			lua_Integer queued = 0;
+
+			// Queues the value at _valueIndex, its path must be on top of the stack and is popped.
+			void enqueue(int _valueIndex)
+			{
+				_valueIndex = abs(this->lua, _valueIndex);
+				if (!is_traversable(lua_type(this->lua, _valueIndex)))
+				{
+					pop(this->lua);
+					return;
+				};
+
+				copy(this->lua, _valueIndex);
+				const auto _seen = lua_rawget(this->lua, this->seen) != LUA_TNIL;
+				pop(this->lua);
+				if (_seen)
+				{
+					pop(this->lua);
+					return;
+				};
+
+				copy(this->lua, _valueIndex);
+				lua_pushboolean(this->lua, true);
+				rawset(this->lua, this->seen);
+
+				++this->queued;
+				rawset(this->lua, this->paths, this->queued);
+				copy(this->lua, _valueIndex);
+				rawset(this->lua, this->queue, this->queued);
+			};
+		};
+
+		// Pushes the path of a value found under _key in the value with path _parent
+		void push_child_path(state_ptr _lua, const char* _parent, int _keyIndex)
+		{
+			switch (lua_type(_lua, _keyIndex))
+			{
+			case LUA_TSTRING:
+				lua_pushfstring(_lua, "%s.%s", _parent, lua_tostring(_lua, _keyIndex));
+				break;
+			case LUA_TNUMBER:
+				if (lua_isinteger(_lua, _keyIndex))
+				{
+					lua_pushfstring(_lua, "%s[%I]", _parent, lua_tointeger(_lua, _keyIndex));
+				}
+				else
+				{
+					lua_pushfstring(_lua, "%s[%f]", _parent, lua_tonumber(_lua, _keyIndex));
+				};
+				break;
+			default:
+				lua_pushfstring(_lua, "%s[%s: %p]", _parent, luaL_typename(_lua, _keyIndex), lua_topointer(_lua, _keyIndex));
+				break;
+			};
+		};
+
+		// Analyzes the table at _index, returns false when it has nothing to report
+		bool analyze_table(state_ptr _lua, int _index, const table_shape_options& _options, table_shape& _shape)
+		{
+			_shape.usage = get_table_usage(_lua, _index);
+			const auto _total = _shape.usage.array_count + _shape.usage.hash_count;
+			if (_total < _options.min_entries)
+			{
+				return false;
+			};
+
+			lua_pushnil(_lua);
+			while (next(_lua, _index))
+			{
+				pop(_lua);
+				if (lua_isinteger(_lua, -1))
+				{
+					const auto _key = lua_tointeger(_lua, -1);
+					if (_key >= 1)
+					{
+						++_shape.integer_keys;
+						_shape.max_integer_key = std::max(_shape.max_integer_key, _key);
+					};
+				};
+			};
+			_shape.integer_keys_in_hash = _shape.integer_keys - std::min(_shape.integer_keys, _shape.usage.array_count);
+
+			auto _issues = table_shape_issue::none;
+			if (_shape.integer_keys_in_hash != 0)
+			{
+				const auto _range = static_cast<lua_Unsigned>(_shape.max_integer_key);
+				_issues = _issues | ((_range > 2 * static_cast<lua_Unsigned>(_shape.integer_keys)) ?
+					table_shape_issue::sparse_array : table_shape_issue::integer_keys_in_hash);
+			};
+
+			const auto& _usage = _shape.usage;
+			if (_usage.sizes_known)
+			{
+				if (_usage.hash_size >= min_oversized_slots && _usage.hash_count * 4 < _usage.hash_size)
+				{
+					_issues = _issues | table_shape_issue::oversized_hash;
+				};
+				if (_usage.array_size >= min_oversized_slots && _usage.array_count * 4 < _usage.array_size)
+				{
+					_issues = _issues | table_shape_issue::oversized_array;
+				};
+			};
+
+			// Value types of the sequence, nils are holes and ignored
+			const auto _length = static_cast<lua_Integer>(rawlen(_lua, _index));
+			int _firstType = LUA_TNONE;
+			for (lua_Integer n = 1; n <= _length; ++n)
+			{
+				const auto _type = lua_rawgeti(_lua, _index, n);
+				pop(_lua);
+				if (_type == LUA_TNIL)
+				{
+					continue;
+				};
+				if (_firstType == LUA_TNONE)
+				{
+					_firstType = _type;
+				}
+				else if (_type != _firstType)
+				{
+					_issues = _issues | table_shape_issue::mixed_array;
+					break;
+				};
+			};
+
+			_shape.issues = _issues;
+			if (_issues == table_shape_issue::none)
+			{
+				return false;
+			};
+
+			_shape.estimated_waste = _usage.slack_bytes;
+			if ((_issues & table_shape_issue::integer_keys_in_hash) != table_shape_issue::none)
+			{
+				_shape.estimated_waste += _shape.integer_keys_in_hash * (estimated_node_bytes - estimated_value_bytes);
+			};
+			return true;
+		};
+	};
+
+	std::vector<table_shape> analyze_table_shapes(state_ptr _lua, const table_shape_options& _options)
+	{
+		std::vector<table_shape> _shapes{};
+
+		luaL_checkstack(_lua, 12, nullptr);
+		const auto _base = top(_lua);
+		newtable(_lua);
+		newtable(_lua);
+		newtable(_lua);
+		auto _walk = walk{ _lua, _base + 1, _base + 2, _base + 3 };
+
+		lua_rawgeti(_lua, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
+		lua_pushliteral(_lua, "_G");
+		_walk.enqueue(-2);
+		pop(_lua);
+		lua_pushvalue(_lua, LUA_REGISTRYINDEX);
+		lua_pushliteral(_lua, "registry");
+		_walk.enqueue(-2);
+		pop(_lua);
+
+		for (lua_Integer n = 1; n <= _walk.queued; ++n)
+		{
+			rawget(_lua, _walk.queue, n);
+			rawget(_lua, _walk.paths, n);
+			const auto _value = top(_lua) - 1;
+			const auto _path = lua_tostring(_lua, -1);
+
+			switch (lua_type(_lua, _value))
+			{
+			case LUA_TTABLE:
+			{
+				table_shape _shape{};
+				if (analyze_table(_lua, _value, _options, _shape))
+				{
+					_shape.path = _path;
+					_shape.table = lua_topointer(_lua, _value);
+					_shapes.push_back(std::move(_shape));
+				};
+
+				lua_pushnil(_lua);
+				while (next(_lua, _value))
+				{
+					const auto _keyIndex = top(_lua) - 1;
+					lua_pushfstring(_lua, "%s[key]", _path);
+					_walk.enqueue(_keyIndex);
+					push_child_path(_lua, _path, _keyIndex);
+					_walk.enqueue(-2);
+					pop(_lua);
+				};
+				break;
+			}
+			case LUA_TFUNCTION:
+				for (int _upvalue = 1; ; ++_upvalue)
+				{
+					const auto _name = lua_getupvalue(_lua, _value, _upvalue);
+					if (!_name)
+					{
+						break;
+					};
+					lua_pushfstring(_lua, "%s<upvalue %s>", _path, (*_name) ? _name : "?");
+					_walk.enqueue(-2);
+					pop(_lua);
+				};
+				break;
+			case LUA_TUSERDATA:
+				for (int _userValue = 1; lua_getiuservalue(_lua, _value, _userValue) != LUA_TNONE; ++_userValue)
+				{
+					lua_pushfstring(_lua, "%s<uservalue %d>", _path, _userValue);
+					_walk.enqueue(-2);
+					pop(_lua);
+				};
+				pop(_lua);
+				break;
+			default:
+				break;
+			};
+
+			if (lua_getmetatable(_lua, _value))
+			{
+				lua_pushfstring(_lua, "%s<metatable>", _path);
+				_walk.enqueue(-2);
+				pop(_lua);
+			};
+			lua_settop(_lua, _base + 3);
+		};
+
+		lua_settop(_lua, _base);
+		std::ranges::sort(_shapes, std::ranges::greater{}, &table_shape::estimated_waste);
+		return _shapes;
+	};
+};
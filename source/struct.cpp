@@ -0,0 +1,725 @@
+#include <luacpp.hpp>
+
+#include "byte_access.hpp"
+
+#include <new>
+#include <cstddef>
+
+namespace lua
+{
+	namespace
+	{
+		/*
+			"struct.format" userdata layout : a format_header followed by op_count format_op entries,
+			both trivially destructible so the userdata needs no __gc.
+
+			Options and their semantics are exactly those of string.pack, endianness and maximum
+			alignment options are folded into the ops that follow them.
+		*/
+
+		enum class format_kind : uint8_t
+		{
+			integer,			// b h l j i[n]
+			unsigned_integer,	// B H L J T I[n]
+			float32,			// f
+			number,				// n
+			float64,			// d
+			chars,				// c[n]
+			string,				// s[n]
+			zstring,			// z
+			padding,			// x
+			align_to,			// X
+			none,				// ' ' < > = ![n], never stored
+		};
+
+		struct format_op
+		{
+			format_kind kind;
+			bool little;
+			uint16_t align;	// 1 when unaligned
+			size_t size;	// size of the value, or of the length prefix for 's'
+		};
+
+		struct format_header
+		{
+			size_t op_count;
+			size_t value_count;
+			size_t min_size;	// size of a record with empty strings
+			bool variable;		// contains 's' or 'z'
+
+			format_op* ops() noexcept
+			{
+				return reinterpret_cast<format_op*>(this + 1);
+			};
+			const format_op* ops() const noexcept
+			{
+				return reinterpret_cast<const format_op*>(this + 1);
+			};
+		};
+
+		static_assert(sizeof(format_header) % alignof(format_op) == 0);
+		static_assert(std::is_trivially_destructible_v<format_header> && std::is_trivially_destructible_v<format_op>);
+
+		// Limits from lstrlib.c
+		constexpr size_t max_int_size = 16;
+		constexpr size_t max_format_size = (sizeof(size_t) < sizeof(int)) ? static_cast<size_t>(-1) : static_cast<size_t>(INT_MAX);
+		constexpr size_t native_max_align = alignof(std::max_align_t);
+
+		struct format_parse_state
+		{
+			bool little = std::endian::native == std::endian::little;
+			size_t max_align = 1;
+		};
+
+		constexpr bool is_digit(char c) noexcept
+		{
+			return c >= '0' && c <= '9';
+		};
+
+		size_t read_format_number(const char*& _fmt, size_t _default)
+		{
+			if (!is_digit(*_fmt))
+			{
+				return _default;
+			};
+			size_t _value = 0;
+			do
+			{
+				_value = _value * 10 + static_cast<size_t>(*_fmt++ - '0');
+			} while (is_digit(*_fmt) && _value <= (max_format_size - 9) / 10);
+			return _value;
+		};
+
+		size_t read_format_limit(state_ptr _lua, const char*& _fmt, size_t _default)
+		{
+			const auto _size = read_format_number(_fmt, _default);
+			if (_size > max_int_size || _size == 0)
+			{
+				luaL_error(_lua, "integral size (%d) out of limits [1,%d]", static_cast<int>(_size), static_cast<int>(max_int_size));
+			};
+			return _size;
+		};
+
+		// Reads a single option, lstrlib's getoption
+		format_kind read_option(state_ptr _lua, const char*& _fmt, format_parse_state& _state, size_t& _size)
+		{
+			const char _option = *_fmt++;
+			_size = 0;
+			switch (_option)
+			{
+			case 'b': _size = sizeof(char); return format_kind::integer;
+			case 'B': _size = sizeof(char); return format_kind::unsigned_integer;
+			case 'h': _size = sizeof(short); return format_kind::integer;
+			case 'H': _size = sizeof(short); return format_kind::unsigned_integer;
+			case 'l': _size = sizeof(long); return format_kind::integer;
+			case 'L': _size = sizeof(long); return format_kind::unsigned_integer;
+			case 'j': _size = sizeof(lua_Integer); return format_kind::integer;
+			case 'J': _size = sizeof(lua_Integer); return format_kind::unsigned_integer;
+			case 'T': _size = sizeof(size_t); return format_kind::unsigned_integer;
+			case 'f': _size = sizeof(float); return format_kind::float32;
+			case 'n': _size = sizeof(lua_Number); return format_kind::number;
+			case 'd': _size = sizeof(double); return format_kind::float64;
+			case 'i': _size = read_format_limit(_lua, _fmt, sizeof(int)); return format_kind::integer;
+			case 'I': _size = read_format_limit(_lua, _fmt, sizeof(int)); return format_kind::unsigned_integer;
+			case 's': _size = read_format_limit(_lua, _fmt, sizeof(size_t)); return format_kind::string;
+			case 'c':
+				_size = read_format_number(_fmt, static_cast<size_t>(-1));
+				if (_size == static_cast<size_t>(-1))
+				{
+					luaL_error(_lua, "missing size for format option 'c'");
+				};
+				return format_kind::chars;
+			case 'z': return format_kind::zstring;
+			case 'x': _size = 1; return format_kind::padding;
+			case 'X': return format_kind::align_to;
+			case ' ': break;
+			case '<': _state.little = true; break;
+			case '>': _state.little = false; break;
+			case '=': _state.little = std::endian::native == std::endian::little; break;
+			case '!': _state.max_align = read_format_limit(_lua, _fmt, native_max_align); break;
+			default:
+				luaL_error(_lua, "invalid format option '%c'", _option);
+				break;
+			};
+			return format_kind::none;
+		};
+
+		// Reads an option along with its alignment, lstrlib's getdetails
+		format_op read_op(state_ptr _lua, const char*& _fmt, format_parse_state& _state)
+		{
+			format_op _op{};
+			_op.kind = read_option(_lua, _fmt, _state, _op.size);
+			_op.little = _state.little;
+
+			auto _align = _op.size;
+			if (_op.kind == format_kind::align_to)
+			{
+				// Aligns to the size of the next option, which is consumed
+				if (*_fmt == '\0' || read_option(_lua, _fmt, _state, _align) == format_kind::chars || _align == 0)
+				{
+					luaL_argerror(_lua, 1, "invalid next option for option 'X'");
+				};
+			};
+
+			if (_align <= 1 || _op.kind == format_kind::chars)
+			{
+				_op.align = 1;
+			}
+			else
+			{
+				_align = std::min(_align, _state.max_align);
+				if ((_align & (_align - 1)) != 0)
+				{
+					luaL_argerror(_lua, 1, "format asks for alignment not power of 2");
+				};
+				_op.align = static_cast<uint16_t>(_align);
+			};
+			return _op;
+		};
+
+		// Parses a format, writing its ops to _out when given, otherwise only counts them.
+		size_t parse_format(state_ptr _lua, const char* _fmt, format_op* _out)
+		{
+			format_parse_state _state{};
+			size_t _count = 0;
+			while (*_fmt != '\0')
+			{
+				const auto _op = read_op(_lua, _fmt, _state);
+				if (_op.kind == format_kind::none)
+				{
+					continue;
+				};
+				if (_out)
+				{
+					_out[_count] = _op;
+				};
+				++_count;
+			};
+			return _count;
+		};
+
+		constexpr size_t padding_for(size_t _pos, size_t _align) noexcept
+		{
+			return (_align - (_pos & (_align - 1))) & (_align - 1);
+		};
+
+		constexpr bool produces_value(format_kind _kind) noexcept
+		{
+			return _kind != format_kind::padding && _kind != format_kind::align_to;
+		};
+
+		format_header& check_format(state_ptr _lua, int _index)
+		{
+			const auto _format = testudata<format_header>(_lua, _index);
+			if (!_format)
+			{
+				luaL_typeerror(_lua, _index, "struct.format");
+			};
+			return *_format;
+		};
+
+
+
+		void write_integer(char* _dest, lua_Unsigned _value, bool _little, size_t _size, bool _negative)
+		{
+			const auto _endian = (_little) ? std::endian::little : std::endian::big;
+			switch (_size)
+			{
+			case 1: *_dest = static_cast<char>(_value & 0xFF); return;
+			case 2: impl::store_bytes(reinterpret_cast<std::byte*>(_dest), static_cast<uint16_t>(_value), _endian); return;
+			case 4: impl::store_bytes(reinterpret_cast<std::byte*>(_dest), static_cast<uint32_t>(_value), _endian); return;
+			case 8: impl::store_bytes(reinterpret_cast<std::byte*>(_dest), static_cast<uint64_t>(_value), _endian); return;
+			default:
+				break;
+			};
+
+			for (size_t n = 0; n != _size; ++n)
+			{
+				unsigned char _byte = (_negative) ? 0xFF : 0x00;
+				if (n < sizeof(lua_Integer))
+				{
+					_byte = static_cast<unsigned char>((_value >> (n * CHAR_BIT)) & 0xFF);
+				};
+				_dest[(_little) ? n : _size - 1 - n] = static_cast<char>(_byte);
+			};
+		};
+
+		lua_Integer read_integer(state_ptr _lua, const char* _src, bool _little, size_t _size, bool _signed)
+		{
+			const auto _bytes = reinterpret_cast<const std::byte*>(_src);
+			const auto _endian = (_little) ? std::endian::little : std::endian::big;
+			switch (_size)
+			{
+			case 1: return (_signed) ? lua_Integer(static_cast<int8_t>(*_src)) : lua_Integer(static_cast<uint8_t>(*_src));
+			case 2: return (_signed) ? lua_Integer(impl::load_bytes<int16_t>(_bytes, _endian)) : lua_Integer(impl::load_bytes<uint16_t>(_bytes, _endian));
+			case 4: return (_signed) ? lua_Integer(impl::load_bytes<int32_t>(_bytes, _endian)) : lua_Integer(impl::load_bytes<uint32_t>(_bytes, _endian));
+			case 8: return static_cast<lua_Integer>(impl::load_bytes<uint64_t>(_bytes, _endian));
+			default:
+				break;
+			};
+
+			const auto _limit = std::min(_size, sizeof(lua_Integer));
+			lua_Unsigned _value = 0;
+			for (size_t n = _limit; n-- != 0;)
+			{
+				_value <<= CHAR_BIT;
+				_value |= static_cast<unsigned char>(_src[(_little) ? n : _size - 1 - n]);
+			};
+
+			if (_size < sizeof(lua_Integer))
+			{
+				if (_signed)
+				{
+					const auto _mask = lua_Unsigned(1) << (_size * CHAR_BIT - 1);
+					_value = (_value ^ _mask) - _mask;
+				};
+			}
+			else if (_size > sizeof(lua_Integer))
+			{
+				// Extra bytes must be a sign extension
+				const unsigned char _extension = (!_signed || static_cast<lua_Integer>(_value) >= 0) ? 0x00 : 0xFF;
+				for (size_t n = _limit; n != _size; ++n)
+				{
+					if (static_cast<unsigned char>(_src[(_little) ? n : _size - 1 - n]) != _extension)
+					{
+						luaL_error(_lua, "%d-byte integer does not fit into Lua Integer", static_cast<int>(_size));
+					};
+				};
+			};
+			return static_cast<lua_Integer>(_value);
+		};
+
+		template <typename T>
+		void write_float(char* _dest, T _value, bool _little)
+		{
+			impl::store_bytes(reinterpret_cast<std::byte*>(_dest), _value, (_little) ? std::endian::little : std::endian::big);
+		};
+
+		template <typename T>
+		T read_float(const char* _src, bool _little)
+		{
+			return impl::load_bytes<T>(reinterpret_cast<const std::byte*>(_src), (_little) ? std::endian::little : std::endian::big);
+		};
+
+
+
+		/*
+			Decodes one record starting at _pos, passing each value to the emitter.
+			Returns the position following the record.
+		*/
+		template <typename EmitT>
+		size_t decode_record(state_ptr _lua, const format_header& _format, std::string_view _data, size_t _pos, EmitT& _emit)
+		{
+			const auto _ops = _format.ops();
+			const auto _len = _data.size();
+			for (size_t n = 0; n != _format.op_count; ++n)
+			{
+				const auto& _op = _ops[n];
+				const auto _padding = padding_for(_pos, _op.align);
+				luaL_argcheck(_lua, _padding <= _len - _pos && _op.size <= _len - _pos - _padding, 2, "data string too short");
+				_pos += _padding;
+
+				const auto _src = _data.data() + _pos;
+				switch (_op.kind)
+				{
+				case format_kind::integer:
+					_emit.integer(read_integer(_lua, _src, _op.little, _op.size, true));
+					break;
+				case format_kind::unsigned_integer:
+					_emit.integer(read_integer(_lua, _src, _op.little, _op.size, false));
+					break;
+				case format_kind::float32:
+					_emit.float32(read_float<float>(_src, _op.little));
+					break;
+				case format_kind::number:
+					_emit.number(read_float<lua_Number>(_src, _op.little));
+					break;
+				case format_kind::float64:
+					_emit.float64(read_float<double>(_src, _op.little));
+					break;
+				case format_kind::chars:
+					_emit.string(_src, _op.size);
+					break;
+				case format_kind::string:
+				{
+					const auto _strlen = static_cast<size_t>(read_integer(_lua, _src, _op.little, _op.size, false));
+					luaL_argcheck(_lua, _strlen <= _len - _pos - _op.size, 2, "data string too short");
+					_emit.string(_src + _op.size, _strlen);
+					_pos += _strlen;
+					break;
+				}
+				case format_kind::zstring:
+				{
+					const auto _end = static_cast<const char*>(std::memchr(_src, '\0', _len - _pos));
+					luaL_argcheck(_lua, _end != nullptr, 2, "unfinished string for format 'z'");
+					_emit.string(_src, static_cast<size_t>(_end - _src));
+					_pos += static_cast<size_t>(_end - _src) + 1;
+					break;
+				}
+				default:
+					break;
+				};
+				_pos += _op.size;
+			};
+			return _pos;
+		};
+
+		// Pushes decoded values onto the stack
+		struct stack_emitter
+		{
+			state_ptr lua;
+
+			void integer(lua_Integer _value) { lua_pushinteger(this->lua, _value); };
+			void float32(float _value) { lua_pushnumber(this->lua, static_cast<lua_Number>(_value)); };
+			void number(lua_Number _value) { lua_pushnumber(this->lua, _value); };
+			void float64(double _value) { lua_pushnumber(this->lua, static_cast<lua_Number>(_value)); };
+			void string(const char* _str, size_t _len) { lua_pushlstring(this->lua, _str, _len); };
+		};
+
+		/*
+			Column of unpack_many, values are typed arrays (see push_array) or tables of strings.
+			Lives in a scratch userdata, so it must stay trivially destructible.
+		*/
+		struct column
+		{
+			void* values;	// std::vector of the column's element type, nullptr for string columns
+			int table;		// stack index of the table of a string column
+		};
+
+		// Appends decoded values to the columns
+		struct column_emitter
+		{
+			state_ptr lua;
+			column* columns;
+			column* next = nullptr;
+			lua_Integer row = 0;
+
+			template <typename T>
+			void append(T _value)
+			{
+				static_cast<std::vector<T>*>((this->next++)->values)->push_back(_value);
+			};
+
+			void integer(lua_Integer _value) { this->append(_value); };
+			void float32(float _value) { this->append(_value); };
+			void number(lua_Number _value) { this->append(_value); };
+			void float64(double _value) { this->append(_value); };
+			void string(const char* _str, size_t _len)
+			{
+				const auto _table = (this->next++)->table;
+				lua_pushlstring(this->lua, _str, _len);
+				lua_rawseti(this->lua, _table, this->row);
+			};
+		};
+
+
+
+		// (self, ...) -> string
+		int format_pack(state_ptr _lua)
+		{
+			const auto& _format = check_format(_lua, 1);
+			const auto _ops = _format.ops();
+
+			// Exact size, only depends on the arguments when the format has strings
+			auto _total = _format.min_size;
+			if (_format.variable)
+			{
+				_total = 0;
+				int _arg = 2;
+				for (size_t n = 0; n != _format.op_count; ++n)
+				{
+					const auto& _op = _ops[n];
+					_total += padding_for(_total, _op.align);
+					size_t _extra = 0;
+					if (_op.kind == format_kind::string || _op.kind == format_kind::zstring)
+					{
+						luaL_checklstring(_lua, _arg, &_extra);
+						if (_op.kind == format_kind::zstring)
+						{
+							++_extra;
+						};
+					};
+					luaL_argcheck(_lua, _op.size + _extra <= max_format_size - _total, _arg, "format result too large");
+					_total += _op.size + _extra;
+					_arg += produces_value(_op.kind);
+				};
+			};
+
+			buffer _buffer{};
+			const auto _begin = init(_lua, _buffer, _total);
+			auto _dest = _begin;
+
+			int _arg = 2;
+			for (size_t n = 0; n != _format.op_count; ++n)
+			{
+				const auto& _op = _ops[n];
+				const auto _padding = padding_for(static_cast<size_t>(_dest - _begin), _op.align);
+				std::memset(_dest, 0, _padding);
+				_dest += _padding;
+
+				switch (_op.kind)
+				{
+				case format_kind::integer:
+				{
+					const auto _value = luaL_checkinteger(_lua, _arg);
+					if (_op.size < sizeof(lua_Integer))
+					{
+						const auto _limit = lua_Integer(1) << (_op.size * CHAR_BIT - 1);
+						luaL_argcheck(_lua, -_limit <= _value && _value < _limit, _arg, "integer overflow");
+					};
+					write_integer(_dest, static_cast<lua_Unsigned>(_value), _op.little, _op.size, _value < 0);
+					break;
+				}
+				case format_kind::unsigned_integer:
+				{
+					const auto _value = luaL_checkinteger(_lua, _arg);
+					if (_op.size < sizeof(lua_Integer))
+					{
+						luaL_argcheck(_lua, static_cast<lua_Unsigned>(_value) < (lua_Unsigned(1) << (_op.size * CHAR_BIT)), _arg, "unsigned overflow");
+					};
+					write_integer(_dest, static_cast<lua_Unsigned>(_value), _op.little, _op.size, false);
+					break;
+				}
+				case format_kind::float32:
+					write_float(_dest, static_cast<float>(luaL_checknumber(_lua, _arg)), _op.little);
+					break;
+				case format_kind::number:
+					write_float(_dest, luaL_checknumber(_lua, _arg), _op.little);
+					break;
+				case format_kind::float64:
+					write_float(_dest, static_cast<double>(luaL_checknumber(_lua, _arg)), _op.little);
+					break;
+				case format_kind::chars:
+				{
+					size_t _len = 0;
+					const auto _str = luaL_checklstring(_lua, _arg, &_len);
+					luaL_argcheck(_lua, _len <= _op.size, _arg, "string longer than given size");
+					std::memcpy(_dest, _str, _len);
+					std::memset(_dest + _len, 0, _op.size - _len);
+					break;
+				}
+				case format_kind::string:
+				{
+					size_t _len = 0;
+					const auto _str = luaL_checklstring(_lua, _arg, &_len);
+					luaL_argcheck(_lua, _op.size >= sizeof(size_t) || _len < (size_t(1) << (_op.size * CHAR_BIT)),
+						_arg, "string length does not fit in given size");
+					write_integer(_dest, static_cast<lua_Unsigned>(_len), _op.little, _op.size, false);
+					std::memcpy(_dest + _op.size, _str, _len);
+					_dest += _len;
+					break;
+				}
+				case format_kind::zstring:
+				{
+					size_t _len = 0;
+					const auto _str = luaL_checklstring(_lua, _arg, &_len);
+					luaL_argcheck(_lua, std::strlen(_str) == _len, _arg, "string contains zeros");
+					std::memcpy(_dest, _str, _len + 1);
+					_dest += _len + 1;
+					break;
+				}
+				case format_kind::padding:
+					*_dest = '\0';
+					break;
+				default:
+					break;
+				};
+				_dest += _op.size;
+				_arg += produces_value(_op.kind);
+			};
+
+			push(std::move(_buffer), static_cast<size_t>(_dest - _begin));
+			return 1;
+		};
+
+		// (self, data [, pos]) -> ..., next position
+		int format_unpack(state_ptr _lua)
+		{
+			const auto& _format = check_format(_lua, 1);
+			const auto _data = impl::check_byte_string(_lua, 2);
+			const auto _pos = impl::posrelat_start(luaL_optinteger(_lua, 3, 1), _data.size()) - 1;
+			luaL_argcheck(_lua, _pos <= _data.size(), 3, "initial position out of string");
+			luaL_checkstack(_lua, static_cast<int>(std::min<size_t>(_format.value_count, INT_MAX - 1)) + 1, "too many results");
+
+			auto _emit = stack_emitter{ _lua };
+			const auto _next = decode_record(_lua, _format, _data, _pos, _emit);
+			lua_pushinteger(_lua, static_cast<lua_Integer>(_next + 1));
+			return static_cast<int>(_format.value_count) + 1;
+		};
+
+		/*
+			(self, data [, count [, pos]]) -> column..., next position
+
+			Decodes count records (all remaining records when count is nil). Each value of the format
+			produces a column : integers, 'f', 'n' and 'd' values become typed arrays, strings become tables.
+		*/
+		int format_unpack_many(state_ptr _lua)
+		{
+			const auto& _format = check_format(_lua, 1);
+			const auto _data = impl::check_byte_string(_lua, 2);
+			const bool _hasCount = !lua_isnoneornil(_lua, 3);
+			const auto _count = luaL_optinteger(_lua, 3, 0);
+			luaL_argcheck(_lua, _count >= 0, 3, "count must not be negative");
+			auto _pos = impl::posrelat_start(luaL_optinteger(_lua, 4, 1), _data.size()) - 1;
+			luaL_argcheck(_lua, _pos <= _data.size(), 4, "initial position out of string");
+			luaL_argcheck(_lua, _hasCount || _format.min_size != 0, 1, "cannot repeat a format of size 0");
+
+			luaL_checkstack(_lua, static_cast<int>(std::min<size_t>(_format.value_count, INT_MAX - 2)) + 2, "too many results");
+
+			// Presize using the record count, bounded by the records the remaining data can hold
+			auto _expected = (_data.size() - _pos) / std::max<size_t>(_format.min_size, 1);
+			if (_hasCount)
+			{
+				_expected = std::min(_expected, static_cast<size_t>(_count));
+			};
+			const auto _tableSize = static_cast<int>(std::min<size_t>(_expected, INT_MAX));
+
+			// Columns are created before decoding so that a decoding error leaves nothing to clean up
+			const auto _columns = static_cast<column*>(newuserdata(_lua, sizeof(column) * std::max<size_t>(_format.value_count, 1), 0));
+			const auto _ops = _format.ops();
+			bool _outOfMemory = false;
+			try
+			{
+				auto _column = _columns;
+				for (size_t n = 0; n != _format.op_count; ++n)
+				{
+					const auto _kind = _ops[n].kind;
+					if (!produces_value(_kind))
+					{
+						continue;
+					};
+
+					auto& _new = *_column++;
+					_new = column{ nullptr, 0 };
+					switch (_kind)
+					{
+					case format_kind::integer: [[fallthrough]];
+					case format_kind::unsigned_integer:
+						_new.values = &push_array(_lua, std::vector<lua_Integer>{});
+						static_cast<std::vector<lua_Integer>*>(_new.values)->reserve(_expected);
+						break;
+					case format_kind::float32:
+						_new.values = &push_array(_lua, std::vector<float>{});
+						static_cast<std::vector<float>*>(_new.values)->reserve(_expected);
+						break;
+					case format_kind::number:
+						_new.values = &push_array(_lua, std::vector<lua_Number>{});
+						static_cast<std::vector<lua_Number>*>(_new.values)->reserve(_expected);
+						break;
+					case format_kind::float64:
+						_new.values = &push_array(_lua, std::vector<double>{});
+						static_cast<std::vector<double>*>(_new.values)->reserve(_expected);
+						break;
+					default:
+						lua_createtable(_lua, _tableSize, 0);
+						_new.table = lua_gettop(_lua);
+						break;
+					};
+				};
+
+				auto _emit = column_emitter{ _lua, _columns };
+				while ((_hasCount) ? _emit.row != _count : _pos != _data.size())
+				{
+					++_emit.row;
+					_emit.next = _columns;
+					_pos = decode_record(_lua, _format, _data, _pos, _emit);
+				};
+			}
+			catch (const std::exception&)
+			{
+				// Only allocations can throw here, length_error included
+				_outOfMemory = true;
+			};
+			if (_outOfMemory)
+			{
+				luaL_error(_lua, "not enough memory");
+			};
+
+			lua_pushinteger(_lua, static_cast<lua_Integer>(_pos + 1));
+			return static_cast<int>(_format.value_count) + 1;
+		};
+
+		// (self) -> integer, size of the packed format, lstrlib's packsize
+		int format_size(state_ptr _lua)
+		{
+			const auto& _format = check_format(_lua, 1);
+			luaL_argcheck(_lua, !_format.variable, 1, "variable-length format");
+			lua_pushinteger(_lua, static_cast<lua_Integer>(_format.min_size));
+			return 1;
+		};
+
+		constexpr luaL_Reg format_methods[] =
+		{
+			{ "pack", &format_pack },
+			{ "unpack", &format_unpack },
+			{ "unpack_many", &format_unpack_many },
+			{ "size", &format_size },
+			{ nullptr, nullptr }
+		};
+
+		void init_format_metatable(state_ptr _lua, int _metatableIndex)
+		{
+			luaL_newlib(_lua, format_methods);
+			lua_setfield(_lua, _metatableIndex, "__index");
+			lua_pushliteral(_lua, "struct.format");
+			lua_setfield(_lua, _metatableIndex, "__name");
+			lua_pushboolean(_lua, false);
+			lua_setfield(_lua, _metatableIndex, "__metatable");
+		};
+
+
+
+		// (fmt) -> struct.format
+		int struct_compile(state_ptr _lua)
+		{
+			const auto _fmt = luaL_checkstring(_lua, 1);
+
+			// Count first so the ops can be parsed straight into the userdata
+			const auto _count = parse_format(_lua, _fmt, nullptr);
+			auto& _format = *new (newuserdata(_lua, sizeof(format_header) + _count * sizeof(format_op), 0)) format_header{};
+			_format.op_count = parse_format(_lua, _fmt, _format.ops());
+
+			const auto _ops = _format.ops();
+			size_t _size = 0;
+			for (size_t n = 0; n != _format.op_count; ++n)
+			{
+				const auto& _op = _ops[n];
+				_size += padding_for(_size, _op.align);
+				luaL_argcheck(_lua, _op.size <= max_format_size - _size, 1, "format result too large");
+				_size += _op.size;
+
+				switch (_op.kind)
+				{
+				case format_kind::zstring:
+					// Terminator of an empty string
+					luaL_argcheck(_lua, _size < max_format_size, 1, "format result too large");
+					++_size;
+					[[fallthrough]];
+				case format_kind::string:
+					_format.variable = true;
+					break;
+				default:
+					break;
+				};
+				_format.value_count += produces_value(_op.kind);
+			};
+			_format.min_size = _size;
+
+			get_or_create_metatable<format_header>(_lua, &init_format_metatable);
+			setmetatable(_lua, -2);
+			return 1;
+		};
+
+		constexpr luaL_Reg struct_functions[] =
+		{
+			{ "compile", &struct_compile },
+			{ nullptr, nullptr }
+		};
+	};
+
+	int open_struct(state_ptr _lua)
+	{
+		luaL_newlib(_lua, struct_functions);
+		return 1;
+	};
+};
@@ -0,0 +1,358 @@
+#include <luacpp.hpp>
+
+#include <climits>
+
+/*
+	Exact table resizing needs the lua internals, which are available when building against
+	the lua sources. Define LUA_CPP_LUA_INTERNALS to 0 or 1 to override the detection.
+*/
+#ifndef LUA_CPP_LUA_INTERNALS
+	#if LUA_VERSION_NUM == 504 && __has_include(<ltable.h>)
+		#define LUA_CPP_LUA_INTERNALS 1
+	#else
+		#define LUA_CPP_LUA_INTERNALS 0
+	#endif
+#endif
+
+#if LUA_CPP_LUA_INTERNALS
+extern "C"
+{
+	#include <lobject.h>
+	#include <ltable.h>
+};
+#endif
+
+namespace lua
+{
+	namespace
+	{
+		/*
+			The per-state table pool is a sequence of free tables stored in the registry.
+		*/
+
+		struct table_pool_tag {};
+
+		/*
+			Live entry counts and the array size a rehash would pick for them, lua's computesizes.
+		*/
+		struct table_counts
+		{
+			size_t total = 0;
+			size_t array_count = 0;
+			size_t array_size = 0;
+		};
+
+		table_counts count_entries(state_ptr _lua, int _index)
+		{
+			// _slices[i] counts the integer keys in (2^(i-1), 2^i]
+			constexpr size_t max_bits = std::min<size_t>(sizeof(unsigned int) * CHAR_BIT - 1, 31);
+			size_t _slices[max_bits + 1]{};
+			size_t _integerKeys = 0;
+
+			table_counts _counts{};
+			lua_pushnil(_lua);
+			while (next(_lua, _index))
+			{
+				pop(_lua);
+				++_counts.total;
+				if (lua_isinteger(_lua, -1))
+				{
+					const auto _key = lua_tointeger(_lua, -1);
+					if (_key >= 1 && static_cast<lua_Unsigned>(_key) <= (lua_Unsigned(1) << max_bits))
+					{
+						++_slices[std::bit_width(static_cast<lua_Unsigned>(_key) - 1)];
+						++_integerKeys;
+					};
+				};
+			};
+
+			// Largest power of two size that is more than half used
+			size_t _used = 0;
+			for (size_t n = 0, _size = 1; n <= max_bits && _integerKeys > _size / 2; ++n, _size *= 2)
+			{
+				_used += _slices[n];
+				if (_used > _size / 2)
+				{
+					_counts.array_size = _size;
+					_counts.array_count = _used;
+				};
+			};
+			return _counts;
+		};
+
+		// Tables beyond this many are left to the garbage collector
+		constexpr lua_Integer max_pooled_tables = 256;
+
+		// Pushes the table pool, creating it on first use
+		void push_table_pool(state_ptr _lua)
+		{
+			const auto _key = impl::type_key<table_pool_tag>();
+			if (rawget(_lua, LUA_REGISTRYINDEX, _key) == type::table)
+			{
+				return;
+			};
+			pop(_lua);
+			newtable(_lua, static_cast<int>(max_pooled_tables), 0);
+			copy(_lua, -1);
+			rawset(_lua, LUA_REGISTRYINDEX, _key);
+		};
+
+		int check_size(state_ptr _lua, int _arg)
+		{
+			const auto _size = luaL_optinteger(_lua, _arg, 0);
+			luaL_argcheck(_lua, _size >= 0 && _size <= INT_MAX, _arg, "size out of range");
+			return static_cast<int>(_size);
+		};
+
+		// ([narr [, nrec]]) -> table
+		int tablex_new(state_ptr _lua)
+		{
+			const auto _narr = check_size(_lua, 1);
+			const auto _nrec = check_size(_lua, 2);
+			newtable(_lua, _narr, _nrec);
+			return 1;
+		};
+
+		// (t) -> t
+		int tablex_clear(state_ptr _lua)
+		{
+			luaL_checktype(_lua, 1, LUA_TTABLE);
+			cleartable(_lua, 1);
+			lua_settop(_lua, 1);
+			return 1;
+		};
+
+		// ([narr [, nrec]]) -> table, reuses a released table when one is available
+		int tablex_acquire(state_ptr _lua)
+		{
+			const auto _narr = check_size(_lua, 1);
+			const auto _nrec = check_size(_lua, 2);
+
+			push_table_pool(_lua);
+			const auto _count = static_cast<lua_Integer>(rawlen(_lua, -1));
+			if (_count == 0)
+			{
+				newtable(_lua, _narr, _nrec);
+				return 1;
+			};
+
+			rawget(_lua, -1, _count);
+			lua_pushnil(_lua);
+			rawset(_lua, -3, _count);
+			return 1;
+		};
+
+		// (t), clears a table and returns it to the pool, it must not be used afterwards
+		int tablex_release(state_ptr _lua)
+		{
+			luaL_checktype(_lua, 1, LUA_TTABLE);
+			lua_settop(_lua, 1);
+
+			push_table_pool(_lua);
+			const auto _count = static_cast<lua_Integer>(rawlen(_lua, 2));
+			if (_count >= max_pooled_tables)
+			{
+				return 0;
+			};
+
+			cleartable(_lua, 1);
+			lua_pushnil(_lua);
+			lua_setmetatable(_lua, 1);
+			lua_pushvalue(_lua, 1);
+			rawset(_lua, 2, _count + 1);
+			return 0;
+		};
+
+		// () -> integer, number of pooled tables
+		int tablex_pooled(state_ptr _lua)
+		{
+			push_table_pool(_lua);
+			lua_pushinteger(_lua, static_cast<lua_Integer>(rawlen(_lua, -1)));
+			return 1;
+		};
+
+		// (t) -> t
+		int tablex_compact(state_ptr _lua)
+		{
+			luaL_checktype(_lua, 1, LUA_TTABLE);
+			lua_settop(_lua, 1);
+			compact(_lua, 1);
+			return 1;
+		};
+
+		// (t) -> { array, hash [, array_size, hash_size, slack_bytes] }
+		int tablex_usage(state_ptr _lua)
+		{
+			luaL_checktype(_lua, 1, LUA_TTABLE);
+			const auto _usage = get_table_usage(_lua, 1);
+
+			newtable(_lua, 0, 5);
+			lua_pushinteger(_lua, static_cast<lua_Integer>(_usage.array_count));
+			lua_setfield(_lua, -2, "array");
+			lua_pushinteger(_lua, static_cast<lua_Integer>(_usage.hash_count));
+			lua_setfield(_lua, -2, "hash");
+			if (_usage.sizes_known)
+			{
+				lua_pushinteger(_lua, static_cast<lua_Integer>(_usage.array_size));
+				lua_setfield(_lua, -2, "array_size");
+				lua_pushinteger(_lua, static_cast<lua_Integer>(_usage.hash_size));
+				lua_setfield(_lua, -2, "hash_size");
+				lua_pushinteger(_lua, static_cast<lua_Integer>(_usage.slack_bytes));
+				lua_setfield(_lua, -2, "slack_bytes");
+			};
+			return 1;
+		};
+
+		// ([min_entries]) -> { { path, issues, waste, array, hash }, ... }
+		int tablex_analyze(state_ptr _lua)
+		{
+			auto _options = table_shape_options{};
+			if (!lua_isnoneornil(_lua, 1))
+			{
+				_options.min_entries = static_cast<size_t>(check_size(_lua, 1));
+			};
+
+			constexpr std::pair<table_shape_issue, const char*> _issueNames[] =
+			{
+				{ table_shape_issue::integer_keys_in_hash, "integer_keys_in_hash" },
+				{ table_shape_issue::sparse_array, "sparse_array" },
+				{ table_shape_issue::oversized_hash, "oversized_hash" },
+				{ table_shape_issue::oversized_array, "oversized_array" },
+				{ table_shape_issue::mixed_array, "mixed_array" },
+			};
+
+			const auto _shapes = analyze_table_shapes(_lua, _options);
+			newtable(_lua, static_cast<int>(std::min<size_t>(_shapes.size(), INT_MAX)), 0);
+			lua_Integer _count = 0;
+			for (auto& _shape : _shapes)
+			{
+				newtable(_lua, 0, 5);
+				lua_pushlstring(_lua, _shape.path.data(), _shape.path.size());
+				lua_setfield(_lua, -2, "path");
+				lua_pushinteger(_lua, static_cast<lua_Integer>(_shape.estimated_waste));
+				lua_setfield(_lua, -2, "waste");
+				lua_pushinteger(_lua, static_cast<lua_Integer>(_shape.usage.array_count));
+				lua_setfield(_lua, -2, "array");
+				lua_pushinteger(_lua, static_cast<lua_Integer>(_shape.usage.hash_count));
+				lua_setfield(_lua, -2, "hash");
+
+				newtable(_lua);
+				lua_Integer _issueCount = 0;
+				for (auto& [_issue, _name] : _issueNames)
+				{
+					if ((_shape.issues & _issue) != table_shape_issue::none)
+					{
+						lua_pushstring(_lua, _name);
+						rawset(_lua, -2, ++_issueCount);
+					};
+				};
+				lua_setfield(_lua, -2, "issues");
+				rawset(_lua, -2, ++_count);
+			};
+			return 1;
+		};
+
+		constexpr luaL_Reg tablex_functions[] =
+		{
+			{ "new", &tablex_new },
+			{ "clear", &tablex_clear },
+			{ "acquire", &tablex_acquire },
+			{ "release", &tablex_release },
+			{ "pooled", &tablex_pooled },
+			{ "compact", &tablex_compact },
+			{ "usage", &tablex_usage },
+			{ "analyze", &tablex_analyze },
+			{ nullptr, nullptr }
+		};
+	};
+
+	void cleartable(state_ptr _lua, int _index)
+	{
+		_index = abs(_lua, _index);
+
+		// Array part first, it is the common case and needs no traversal
+		const auto _len = static_cast<lua_Integer>(rawlen(_lua, _index));
+		for (lua_Integer n = 1; n <= _len; ++n)
+		{
+			lua_pushnil(_lua);
+			rawset(_lua, _index, n);
+		};
+
+		// Assigning nil to existing fields during traversal is allowed and never resizes the table
+		lua_pushnil(_lua);
+		while (next(_lua, _index))
+		{
+			pop(_lua);
+			copy(_lua, -1);
+			lua_pushnil(_lua);
+			rawset(_lua, _index);
+		};
+	};
+
+	table_usage get_table_usage(state_ptr _lua, int _index)
+	{
+		_index = abs(_lua, _index);
+		const auto _counts = count_entries(_lua, _index);
+
+		table_usage _usage{};
+#if LUA_CPP_LUA_INTERNALS
+		const auto _table = static_cast<const Table*>(lua_topointer(_lua, _index));
+		_usage.array_size = luaH_realasize(_table);
+		_usage.hash_size = (isdummy(_table)) ? 0 : sizenode(_table);
+		for (size_t n = 0; n != _usage.array_size; ++n)
+		{
+			_usage.array_count += !isempty(&_table->array[n]);
+		};
+		_usage.hash_count = _counts.total - _usage.array_count;
+		_usage.slack_bytes = (_usage.array_size - _usage.array_count) * sizeof(TValue) +
+			(_usage.hash_size - std::min(_usage.hash_size, _usage.hash_count)) * sizeof(Node);
+		_usage.sizes_known = true;
+#else
+		_usage.array_count = _counts.array_count;
+		_usage.hash_count = _counts.total - _counts.array_count;
+#endif
+		return _usage;
+	};
+
+	bool compact(state_ptr _lua, int _index)
+	{
+		_index = abs(_lua, _index);
+		const auto _counts = count_entries(_lua, _index);
+
+#if LUA_CPP_LUA_INTERNALS
+		const auto _table = const_cast<Table*>(static_cast<const Table*>(lua_topointer(_lua, _index)));
+		luaH_resize(_lua, _table, static_cast<unsigned int>(_counts.array_size),
+			static_cast<unsigned int>(_counts.total - _counts.array_count));
+		return true;
+#else
+		// Move the entries through a temporary, keys at odd indices and values at even ones
+		luaL_checkstack(_lua, 4, nullptr);
+		newtable(_lua, static_cast<int>(std::min<size_t>(_counts.total * 2, INT_MAX)), 0);
+		const auto _temporary = top(_lua);
+		lua_Integer _pos = 0;
+		lua_pushnil(_lua);
+		while (next(_lua, _index))
+		{
+			copy(_lua, -2);
+			rawset(_lua, _temporary, ++_pos);
+			rawset(_lua, _temporary, ++_pos);
+		};
+
+		cleartable(_lua, _index);
+		for (lua_Integer n = 1; n < _pos; n += 2)
+		{
+			rawget(_lua, _temporary, n);
+			rawget(_lua, _temporary, n + 1);
+			rawset(_lua, _index);
+		};
+		pop(_lua);
+		return false;
+#endif
+	};
+
+	int open_tablex(state_ptr _lua)
+	{
+		luaL_newlib(_lua, tablex_functions);
+		return 1;
+	};
+};
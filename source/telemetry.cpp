@@ -0,0 +1,187 @@
+#include <luacpp.hpp>
+
+#include <chrono>
+
+namespace lua
+{
+	namespace
+	{
+		int64_t now_ns() noexcept
+		{
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+		};
+
+		// Bytes in use by a state, as reported by the collector
+		uint64_t bytes_in_use(state_ptr _lua)
+		{
+			return static_cast<uint64_t>(lua_gc(_lua, LUA_GCCOUNT)) * 1024 +
+				static_cast<uint64_t>(lua_gc(_lua, LUA_GCCOUNTB));
+		};
+	};
+
+	uint64_t hdr_histogram::percentile(double _percentile) const noexcept
+	{
+		if (this->total_ == 0)
+		{
+			return 0;
+		};
+
+		_percentile = std::clamp(_percentile, 0.0, 100.0);
+		auto _rank = static_cast<uint64_t>((_percentile / 100.0) * static_cast<double>(this->total_) + 0.5);
+		_rank = std::clamp<uint64_t>(_rank, 1, this->total_);
+
+		uint64_t _seen = 0;
+		for (size_t n = 0; n != this->counts_.size(); ++n)
+		{
+			_seen += this->counts_[n];
+			if (_seen >= _rank)
+			{
+				return std::min(highest_equivalent_value(n), this->max_);
+			};
+		};
+		return this->max_;
+	};
+
+	void gc_telemetry::reset() noexcept
+	{
+		for (auto& _stats : this->stats_)
+		{
+			_stats.duration_ns.reset();
+			_stats.bytes_collected.reset();
+		};
+		this->burst_frees_ = 0;
+		this->burst_bytes_ = 0;
+	};
+
+	void gc_telemetry::install(state_ptr _lua)
+	{
+		assert(get_gc_telemetry(_lua) == nullptr);
+		this->alloc_ = lua_getallocf(_lua, &this->alloc_userdata_);
+		lua_setallocf(_lua, &gc_telemetry::allocate, this);
+	};
+	void gc_telemetry::uninstall(state_ptr _lua)
+	{
+		assert(get_gc_telemetry(_lua) == this);
+		this->end_burst();
+		lua_setallocf(_lua, this->alloc_, this->alloc_userdata_);
+		this->alloc_ = nullptr;
+		this->alloc_userdata_ = nullptr;
+	};
+
+	void gc_telemetry::record(gc_pause_kind _kind, uint64_t _durationNs, uint64_t _bytes) noexcept
+	{
+		auto& _stats = this->stats_[static_cast<size_t>(_kind)];
+		_stats.duration_ns.record(_durationNs);
+		_stats.bytes_collected.record(_bytes);
+	};
+
+	void gc_telemetry::end_burst() noexcept
+	{
+		if (this->burst_frees_ >= min_burst_frees && !this->explicit_)
+		{
+			const auto _duration = static_cast<uint64_t>(this->burst_end_ - this->burst_start_);
+			LUA_CPP_TRACE2(gc__implicit, _duration, this->burst_bytes_);
+			this->record(gc_pause_kind::implicit, _duration, this->burst_bytes_);
+		};
+		this->burst_frees_ = 0;
+		this->burst_bytes_ = 0;
+	};
+
+	void* gc_telemetry::allocate(void* _userdata, void* _ptr, size_t _oldSize, size_t _newSize)
+	{
+		auto& _telemetry = *static_cast<gc_telemetry*>(_userdata);
+
+		// Only the collector frees objects, anything else ends a burst of frees
+		if (_newSize != 0 || _ptr == nullptr)
+		{
+			if (_telemetry.burst_frees_ != 0)
+			{
+				_telemetry.end_burst();
+			};
+			const auto _result = _telemetry.alloc_(_telemetry.alloc_userdata_, _ptr, _oldSize, _newSize);
+
+			// Lua also frees empty blocks as (nullptr, 0, 0), a null result only means failure for new sizes
+			if (_newSize != 0 && !_result)
+			{
+				LUA_CPP_TRACE2(alloc__fail, _oldSize, _newSize);
+			};
+			return _result;
+		};
+
+		if (_telemetry.burst_frees_ == 0)
+		{
+			_telemetry.burst_start_ = now_ns();
+		};
+		const auto _result = _telemetry.alloc_(_telemetry.alloc_userdata_, _ptr, _oldSize, _newSize);
+		++_telemetry.burst_frees_;
+		_telemetry.burst_bytes_ += _oldSize;
+		_telemetry.burst_end_ = now_ns();
+		return _result;
+	};
+
+	gc_telemetry* get_gc_telemetry(state_ptr _lua)
+	{
+		void* _userdata = nullptr;
+		if (lua_getallocf(_lua, &_userdata) != &gc_telemetry::allocate)
+		{
+			return nullptr;
+		};
+		return static_cast<gc_telemetry*>(_userdata);
+	};
+
+	bool gc_step(state_ptr _lua, int _kilobytes)
+	{
+		const auto _telemetry = get_gc_telemetry(_lua);
+		if (!_telemetry)
+		{
+			LUA_CPP_TRACE2(gc__step__start, _lua, _kilobytes);
+			const auto _finished = lua_gc(_lua, LUA_GCSTEP, _kilobytes) != 0;
+			LUA_CPP_TRACE2(gc__step__done, _lua, _finished);
+			return _finished;
+		};
+
+		_telemetry->end_burst();
+		const auto _before = bytes_in_use(_lua);
+		_telemetry->explicit_ = true;
+		const auto _start = now_ns();
+		LUA_CPP_TRACE2(gc__step__start, _lua, _kilobytes);
+		const auto _finished = lua_gc(_lua, LUA_GCSTEP, _kilobytes) != 0;
+		LUA_CPP_TRACE2(gc__step__done, _lua, _finished);
+		const auto _end = now_ns();
+		_telemetry->explicit_ = false;
+		_telemetry->burst_frees_ = 0;
+		_telemetry->burst_bytes_ = 0;
+
+		const auto _after = bytes_in_use(_lua);
+		_telemetry->record(gc_pause_kind::step, static_cast<uint64_t>(_end - _start), (_before > _after) ? _before - _after : 0);
+		return _finished;
+	};
+
+	void gc_collect(state_ptr _lua)
+	{
+		const auto _telemetry = get_gc_telemetry(_lua);
+		if (!_telemetry)
+		{
+			LUA_CPP_TRACE1(gc__collect__start, _lua);
+			lua_gc(_lua, LUA_GCCOLLECT);
+			LUA_CPP_TRACE1(gc__collect__done, _lua);
+			return;
+		};
+
+		_telemetry->end_burst();
+		const auto _before = bytes_in_use(_lua);
+		_telemetry->explicit_ = true;
+		const auto _start = now_ns();
+		LUA_CPP_TRACE1(gc__collect__start, _lua);
+		lua_gc(_lua, LUA_GCCOLLECT);
+		LUA_CPP_TRACE1(gc__collect__done, _lua);
+		const auto _end = now_ns();
+		_telemetry->explicit_ = false;
+		_telemetry->burst_frees_ = 0;
+		_telemetry->burst_bytes_ = 0;
+
+		const auto _after = bytes_in_use(_lua);
+		_telemetry->record(gc_pause_kind::full, static_cast<uint64_t>(_end - _start), (_before > _after) ? _before - _after : 0);
+	};
+};
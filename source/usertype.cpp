@@ -0,0 +1,230 @@
+#include <luacpp.hpp>
+
+#include "field_access.hpp"
+
+#include <cstdlib>
+
+namespace lua
+{
+	namespace
+	{
+		/*
+			Usertype metatables hold a member table under a light userdata key, it is also the first
+			upvalue of __index and __newindex, the metatable itself is the second. Methods are stored
+			as functions and properties as an integer packing their offset, kind and read-only flag.
+		*/
+		struct usertype_members_tag {};
+
+		constexpr lua_Integer property_readonly_bit = 0x80;
+		constexpr lua_Integer property_kind_mask = 0x7F;
+		constexpr int property_offset_shift = 8;
+
+		lua_Integer pack_property(size_t _offset, field_kind _kind, bool _readonly)
+		{
+			return (static_cast<lua_Integer>(_offset) << property_offset_shift) |
+				((_readonly) ? property_readonly_bit : 0) | static_cast<lua_Integer>(_kind);
+		};
+
+		// Gets the address of the property packed at _propertyIndex in the usertype at index 1
+		std::byte* check_property_address(state_ptr _lua, int _propertyIndex)
+		{
+			if (!lua_getmetatable(_lua, 1) || !lua_rawequal(_lua, -1, lua_upvalueindex(2)))
+			{
+				lua_getfield(_lua, lua_upvalueindex(2), "__name");
+				luaL_typeerror(_lua, 1, lua_tostring(_lua, -1));
+			};
+			pop(_lua);
+
+			const auto _offset = static_cast<size_t>(lua_tointeger(_lua, _propertyIndex) >> property_offset_shift);
+			return static_cast<std::byte*>(lua_touserdata(_lua, 1)) + _offset;
+		};
+
+		// (self, key) -> value | nil
+		int usertype_index(state_ptr _lua)
+		{
+			lua_settop(_lua, 2);
+			copy(_lua, 2);
+			if (lua_rawget(_lua, lua_upvalueindex(1)) != LUA_TNUMBER)
+			{
+				return 1;
+			};
+
+			const auto _packed = lua_tointeger(_lua, 3);
+			const auto _address = check_property_address(_lua, 3);
+			impl::push_field_value(_lua, _address, static_cast<field_kind>(_packed & property_kind_mask));
+			return 1;
+		};
+
+		// (self, key, value)
+		int usertype_newindex(state_ptr _lua)
+		{
+			lua_settop(_lua, 3);
+			copy(_lua, 2);
+			if (lua_rawget(_lua, lua_upvalueindex(1)) != LUA_TNUMBER)
+			{
+				const auto _key = luaL_tolstring(_lua, 2, nullptr);
+				lua_getfield(_lua, lua_upvalueindex(2), "__name");
+				return luaL_error(_lua, "no field '%s' in '%s'", _key, lua_tostring(_lua, -1));
+			};
+
+			const auto _packed = lua_tointeger(_lua, 4);
+			const auto _address = check_property_address(_lua, 4);
+			if (_packed & property_readonly_bit)
+			{
+				return luaL_error(_lua, "field '%s' is read-only", luaL_tolstring(_lua, 2, nullptr));
+			};
+			impl::store_field_value(_lua, _address, static_cast<field_kind>(_packed & property_kind_mask), 3);
+			return 0;
+		};
+
+		// Metamethods copied from base usertypes, the others are specific to each usertype
+		bool is_inherited_metamethod(std::string_view _name)
+		{
+			return _name.starts_with("__") && _name != "__index" && _name != "__newindex" &&
+				_name != "__name" && _name != "__gc" && _name != "__metatable";
+		};
+
+		// Pushes the member table of the usertype metatable at _metatableIndex
+		void push_members(state_ptr _lua, int _metatableIndex)
+		{
+			rawget(_lua, _metatableIndex, impl::type_key<usertype_members_tag>());
+		};
+	};
+
+	namespace impl
+	{
+		void init_usertype_metatable(state_ptr _lua, int _metatableIndex, void* _typeKey, const char* _name, lua_CFunction _gc)
+		{
+			_metatableIndex = abs(_lua, _metatableIndex);
+
+			lua_pushinteger(_lua, 0);
+			rawset(_lua, _metatableIndex, _typeKey);
+
+			newtable(_lua, 0, 8);
+			copy(_lua, -1);
+			rawset(_lua, _metatableIndex, type_key<usertype_members_tag>());
+
+			copy(_lua, -1);
+			copy(_lua, _metatableIndex);
+			lua_pushcclosure(_lua, &usertype_newindex, 2);
+			lua_setfield(_lua, _metatableIndex, "__newindex");
+			copy(_lua, _metatableIndex);
+			lua_pushcclosure(_lua, &usertype_index, 2);
+			lua_setfield(_lua, _metatableIndex, "__index");
+
+			lua_pushstring(_lua, _name);
+			lua_setfield(_lua, _metatableIndex, "__name");
+			lua_pushboolean(_lua, false);
+			lua_setfield(_lua, _metatableIndex, "__metatable");
+			if (_gc)
+			{
+				lua_pushcfunction(_lua, _gc);
+				lua_setfield(_lua, _metatableIndex, "__gc");
+			};
+		};
+
+		void set_usertype_method(state_ptr _lua, int _metatableIndex, const char* _name, lua_CFunction _function)
+		{
+			push_members(_lua, _metatableIndex);
+			lua_pushcfunction(_lua, _function);
+			lua_setfield(_lua, -2, _name);
+			pop(_lua);
+		};
+
+		void set_usertype_property(state_ptr _lua, int _metatableIndex, const char* _name, size_t _offset, field_kind _kind, bool _readonly)
+		{
+			push_members(_lua, _metatableIndex);
+			lua_pushinteger(_lua, pack_property(_offset, _kind, _readonly));
+			lua_setfield(_lua, -2, _name);
+			pop(_lua);
+		};
+
+		void inherit_usertype(state_ptr _lua, int _metatableIndex, void* _baseKey, size_t _offset)
+		{
+			_metatableIndex = abs(_lua, _metatableIndex);
+			if (rawget(_lua, LUA_REGISTRYINDEX, _baseKey) != type::table)
+			{
+				luaL_error(_lua, "base usertype is not registered");
+			};
+			const auto _base = top(_lua);
+
+			// Members, property offsets are moved to the base subobject
+			push_members(_lua, _base);
+			push_members(_lua, _metatableIndex);
+			const auto _baseMembers = top(_lua) - 1;
+			const auto _members = top(_lua);
+			lua_pushnil(_lua);
+			while (lua_next(_lua, _baseMembers))
+			{
+				copy(_lua, -2);
+				if (lua_rawget(_lua, _members) != LUA_TNIL)
+				{
+					pop(_lua, 2);
+					continue;
+				};
+				pop(_lua);
+
+				copy(_lua, -2);
+				if (lua_isinteger(_lua, -2))
+				{
+					lua_pushinteger(_lua, lua_tointeger(_lua, -2) + (static_cast<lua_Integer>(_offset) << property_offset_shift));
+				}
+				else
+				{
+					copy(_lua, -2);
+				};
+				lua_rawset(_lua, _members);
+				pop(_lua);
+			};
+			pop(_lua, 2);
+
+			// Casts to the base and its own bases, then metamethods this usertype does not define
+			lua_pushnil(_lua);
+			while (lua_next(_lua, _base))
+			{
+				const auto _keyType = lua_type(_lua, -2);
+				const bool _isCast = _keyType == LUA_TLIGHTUSERDATA && lua_isinteger(_lua, -1);
+				const bool _isMetamethod = _keyType == LUA_TSTRING && is_inherited_metamethod(lua_tostring(_lua, -2));
+				if (!_isCast && !_isMetamethod)
+				{
+					pop(_lua);
+					continue;
+				};
+
+				copy(_lua, -2);
+				if (lua_rawget(_lua, _metatableIndex) != LUA_TNIL)
+				{
+					pop(_lua, 2);
+					continue;
+				};
+				pop(_lua);
+
+				copy(_lua, -2);
+				if (_isCast)
+				{
+					const auto _baseOffset = lua_tointeger(_lua, -2) >> 1;
+					lua_pushinteger(_lua, ((_baseOffset + static_cast<lua_Integer>(_offset)) << 1) | usertype_base_cast_bit);
+				}
+				else
+				{
+					copy(_lua, -2);
+				};
+				lua_rawset(_lua, _metatableIndex);
+				pop(_lua);
+			};
+			pop(_lua);
+		};
+
+		void usertype_type_error(state_ptr _lua, int _arg, void* _typeKey)
+		{
+			const char* _name = "userdata";
+			if (rawget(_lua, LUA_REGISTRYINDEX, _typeKey) == type::table &&
+				lua_getfield(_lua, -1, "__name") == LUA_TSTRING)
+			{
+				_name = lua_tostring(_lua, -1);
+			};
+			luaL_typeerror(_lua, _arg, _name);
+			std::abort();
+		};
+	};
+};